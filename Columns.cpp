@@ -0,0 +1,391 @@
+#include <Columns.h>
+
+#include <ComparingStream.h>
+#include <SpillStream.h>
+#include <Stats.h>
+#include <Stream.h>
+#include <nested_exception.h>
+#include <parse.h>
+#include <util.h>
+#include <write.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Words of a layout that modify the columns after them,
+// rather than adding a column.
+const char* const modifiers[] = {
+  "native", "little", "big", "absolute", "delta", "for",
+};
+
+// A number scanned from a field, as a literal of the same
+// spelling would be written: signed if it has a sign, and
+// floating-point if it has a fraction or exponent.
+struct Number {
+  enum Kind {
+    UNSIGNED,
+    SIGNED,
+    DOUBLE,
+  } kind;
+  union {
+    Term::Unsigned as_unsigned;
+    Term::Signed as_signed;
+    double as_double;
+  };
+};
+
+bool scan_number(const char*, const char*, Number&);
+bool scan_hex(const char*, const char*, uint64_t&);
+
+bool is_separator(const char character, const char delimiter) {
+  return character == ' ' || character == '\t' || character == '\r'
+    || character == '\n' || character == delimiter;
+}
+
+}
+
+Columns::Columns(const std::string& layout, const char delimiter,
+  const bool aligned, Stream& output)
+  : output(output), delimiter(delimiter), aligned(aligned), alignment(1),
+    boundary(0), next(0), offset(0), fields(0), after_field(false),
+    commented(false), carried(0), line(1), column(0) {
+  std::istringstream words(layout);
+  std::string word, context, modifier;
+  while (words >> word) {
+    if (std::find(std::begin(modifiers), std::end(modifiers), word)
+      != std::end(modifiers)) {
+      context = join(context, word, ' ');
+      modifier = word;
+      continue;
+    }
+    modifier.clear();
+    Column current = { parse_state(join(context, word)),
+      Interpreter::Base(), 0, nullptr, nullptr };
+    const auto& state = current.state;
+    const bool fixed = state.format == Term::INTEGER
+      || state.format == Term::FLOAT || state.format == Term::BFLOAT;
+    if (fixed && (state.width == 8 || state.width == 16
+      || state.width == 32 || state.width == 64))
+      current.size = state.width / 8;
+    if (aligned && !current.size)
+      throw std::runtime_error(join("Unable to align column '", word,
+        "'; only 8-, 16-, 32-, and 64-bit integers and floats can be"
+        " aligned."));
+    alignment = std::max(alignment, current.size);
+    columns.push_back(std::move(current));
+  }
+  if (columns.empty())
+    throw std::runtime_error(join("No columns in layout: '", layout, "'."));
+  if (!modifier.empty())
+    throw std::runtime_error(join("Expected a column after '", modifier,
+      "' in layout: '", layout, "'."));
+}
+
+Columns::~Columns() {}
+
+// Writes each column contiguously, as a struct of arrays,
+// rather than record by record. The columns are buffered
+// separately, within 'memory' bytes in total, but at least a
+// page each, spilling to temporary files beyond it.
+void Columns::transpose(const size_t boundary, const size_t memory) {
+  this->boundary = boundary;
+  const size_t limit = std::max<size_t>(1 << 12, memory / columns.size());
+  for (auto& column : columns) {
+    if (!output.counting())
+      column.spill.reset(new SpillStream(limit));
+    column.stream.reset
+      (column.spill ? new Stream(*column.spill) : new Stream());
+  }
+}
+
+// Reads the input in blocks, each of which begins with any
+// field that the end of the last one cut short.
+void Columns::import(std::istream& input) {
+  std::vector<char> buffer(1 << 20);
+  size_t kept = 0;
+  line = 1;
+  column = 0;
+  commented = false;
+  carried = 0;
+  try {
+    while (true) {
+      {
+        STATS_PHASE(READ);
+        input.read(&buffer[kept], buffer.size() - kept);
+      }
+      STATS(bytes_read += input.gcount());
+      const char* const begin = &buffer[0];
+      const char* const end = begin + kept + input.gcount();
+      const bool last = !input;
+      const auto rest = scan(begin, end, last);
+      if (last) {
+        end_line();
+        break;
+      }
+      kept = end - rest;
+      if (kept == buffer.size())
+        throw std::runtime_error
+          (join("Field longer than ", buffer.size(), " bytes."));
+      std::copy(rest, end, &buffer[0]);
+    }
+  } catch (const different_output&) {
+    throw;
+  } catch (...) {
+    ::throw_with_nested(std::runtime_error
+      (join("At line ", line, ", column ", column, ":")));
+  }
+}
+
+// Checks that the input ended with a whole record.
+void Columns::finish() {
+  if (next != 0)
+    throw std::runtime_error(join("Incomplete record at end of input;"
+      " expected ", columns.size(), " columns but found ", next, "."));
+  if (!boundary)
+    return;
+  for (auto& column : columns) {
+    const auto size = column.stream->size();
+    column.stream.reset();
+    for (auto padding = (boundary - output.size() % boundary) % boundary;
+      padding; --padding)
+      output.write(char(0));
+    if (column.spill)
+      column.spill->copy_to(output);
+    else
+      output.count(size * 8);
+    column.spill.reset();
+  }
+}
+
+// Scans fields up to 'end', unless it may cut the last one
+// short, which is left for the next block, and returns where
+// scanning stopped.
+const char* Columns::scan(const char* const begin, const char* const end,
+  const bool last) {
+  STATS_PHASE(LEX);
+  auto start = begin;
+  auto here = begin;
+  if (commented) {
+    here = std::find(here, end, '\n');
+    commented = here == end;
+  }
+  while (here != end) {
+    const char character = *here;
+    column = carried + (here - start) + 1;
+    if (character == '\n') {
+      end_line();
+      ++line;
+      carried = 0;
+      start = ++here;
+    } else if (character == delimiter) {
+      if (!after_field)
+        throw std::runtime_error("Empty field.");
+      after_field = false;
+      ++here;
+    } else if (is_separator(character, delimiter)) {
+      ++here;
+    } else if (character == '#') {
+      here = std::find(here, end, '\n');
+      commented = here == end;
+    } else {
+      if (after_field)
+        throw std::runtime_error("Expected delimiter between fields.");
+      auto stop = here;
+      while (stop != end && !is_separator(*stop, delimiter))
+        ++stop;
+      if (stop == end && !last)
+        break;
+      field(here, stop);
+      here = stop;
+    }
+  }
+  carried += here - start;
+  return here;
+}
+
+void Columns::field(const char* const begin, const char* const end) {
+  if (delimiter && fields == columns.size())
+    throw std::runtime_error(join("Expected ", columns.size(),
+      " columns but found more."));
+  auto& current = columns[next];
+  auto& target = current.stream ? *current.stream : output;
+  if (aligned)
+    pad(current.size);
+  Number number;
+  if (!scan_number(begin, end, number))
+    throw std::runtime_error
+      (join("Invalid number: '", std::string(begin, end), "'."));
+  switch (number.kind) {
+  case Number::UNSIGNED:
+    STATS(tokens[Stats::INTEGER]++);
+    write_relative_integer
+      (current.state, current.base, number.as_unsigned, target);
+    break;
+  case Number::SIGNED:
+    STATS(tokens[Stats::INTEGER]++);
+    write_relative_integer
+      (current.state, current.base, number.as_signed, target);
+    break;
+  case Number::DOUBLE:
+    STATS(tokens[Stats::FLOAT]++);
+    write_float(current.state, number.as_double, target);
+    break;
+  }
+  STATS(values[current.state.format][current.state.width]++);
+  offset += current.size;
+  ++fields;
+  after_field = delimiter != 0;
+  if (++next == columns.size()) {
+    if (aligned)
+      pad(alignment);
+    next = 0;
+    offset = 0;
+  }
+}
+
+// With a delimiter, each line is one record.
+void Columns::end_line() {
+  if (delimiter && fields) {
+    if (!after_field)
+      throw std::runtime_error("Empty field.");
+    if (fields != columns.size())
+      throw std::runtime_error(join("Expected ", columns.size(),
+        " columns but found ", fields, "."));
+  }
+  fields = 0;
+  after_field = false;
+}
+
+void Columns::pad(const size_t size) {
+  for (; offset % size; ++offset)
+    output.write(char(0));
+}
+
+namespace {
+
+// Powers of ten that are exactly representable as doubles.
+const double exact_powers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Decimal numbers are scanned in one pass. A float whose
+// digits fit in the 53 bits of a double, scaled by an exact
+// power of ten, is correctly rounded by one multiplication or
+// division; any other float, such as 'nan', is left to
+// 'strtod'.
+bool scan_number(const char* here, const char* const end, Number& number) {
+  const auto token = here;
+  const bool negative = *here == '-';
+  const bool sign = negative || *here == '+';
+  if (sign)
+    ++here;
+  uint64_t mantissa = 0;
+  if (end - here > 2 && here[0] == '0' && (here[1] == 'x' || here[1] == 'X')) {
+    if (!scan_hex(here + 2, end, mantissa))
+      return false;
+  } else {
+    bool digits = false, overflow = false, exact = true;
+    int exponent = 0;
+    for (; here != end && unsigned(*here - '0') < 10; ++here) {
+      const unsigned digit = *here - '0';
+      digits = true;
+      if (mantissa > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+        overflow = true;
+      else
+        mantissa = mantissa * 10 + digit;
+    }
+    if (here != end && *here == '.') {
+      exact = false;
+      for (++here; here != end && unsigned(*here - '0') < 10; ++here) {
+        const unsigned digit = *here - '0';
+        digits = true;
+        if (mantissa > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+          overflow = true;
+        } else {
+          mantissa = mantissa * 10 + digit;
+          --exponent;
+        }
+      }
+    }
+    if (digits && here != end && (*here == 'e' || *here == 'E')) {
+      exact = false;
+      ++here;
+      const bool negative_exponent = here != end && *here == '-';
+      if (here != end && (*here == '-' || *here == '+'))
+        ++here;
+      if (here == end)
+        return false;
+      int power = 0;
+      for (; here != end && unsigned(*here - '0') < 10; ++here)
+        if (power < 100000)
+          power = power * 10 + (*here - '0');
+      exponent += negative_exponent ? -power : power;
+    }
+    if (!digits || here != end) {
+      const std::string copy(token, end);
+      char* stop;
+      number.kind = Number::DOUBLE;
+      number.as_double = std::strtod(copy.c_str(), &stop);
+      return stop == copy.c_str() + copy.size();
+    }
+    if (!exact) {
+      number.kind = Number::DOUBLE;
+      if (!overflow && mantissa <= uint64_t(1) << 53
+        && exponent >= -22 && exponent <= 22) {
+        const double value = exponent < 0
+          ? double(mantissa) / exact_powers[-exponent]
+          : double(mantissa) * exact_powers[exponent];
+        number.as_double = negative ? -value : value;
+      } else {
+        number.as_double = std::strtod(std::string(token, end).c_str(),
+          nullptr);
+      }
+      return true;
+    }
+    if (overflow)
+      throw std::runtime_error(join("Integer literal out of range: '",
+        std::string(token, end), "'."));
+  }
+  if (!sign) {
+    number.kind = Number::UNSIGNED;
+    number.as_unsigned = mantissa;
+    return true;
+  }
+  const uint64_t limit = uint64_t(std::numeric_limits<int64_t>::max())
+    + (negative ? 1 : 0);
+  if (mantissa > limit)
+    throw std::runtime_error(join("Integer literal out of range: '",
+      std::string(token, end), "'."));
+  number.kind = Number::SIGNED;
+  number.as_signed = negative ? Term::Signed(0 - mantissa)
+    : Term::Signed(mantissa);
+  return true;
+}
+
+bool scan_hex(const char* here, const char* const end, uint64_t& value) {
+  value = 0;
+  for (; here != end; ++here) {
+    const char character = *here;
+    unsigned digit;
+    if (unsigned(character - '0') < 10)
+      digit = character - '0';
+    else if (unsigned((character | 0x20) - 'a') < 6)
+      digit = (character | 0x20) - 'a' + 10;
+    else
+      return false;
+    if (value >> 60)
+      throw std::runtime_error("Integer literal out of range.");
+    value = value << 4 | digit;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef PROTODATA_COLUMNS_H
+#define PROTODATA_COLUMNS_H
+
+#include <Interpreter.h>
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SpillStream;
+class Stream;
+
+// Imports rows of plain numbers, such as CSV, as records of
+// the column types in a layout such as 'u16 big f32 f32'.
+// Numbers are scanned directly from the input, without the
+// tokens and terms of ordinary source.
+class Columns {
+public:
+  Columns(const std::string&, char, bool, Stream&);
+  Columns(const Columns&) = delete;
+  Columns& operator=(const Columns&) = delete;
+  ~Columns();
+  void transpose(size_t, size_t);
+  void import(std::istream&);
+  void finish();
+private:
+  // When transposed, each column is written to its own stream
+  // until the end of the input.
+  struct Column {
+    Interpreter::State state;
+    Interpreter::Base base;
+    size_t size;
+    std::unique_ptr<SpillStream> spill;
+    std::unique_ptr<Stream> stream;
+  };
+  const char* scan(const char*, const char*, bool);
+  void field(const char*, const char*);
+  void end_line();
+  void pad(size_t);
+  std::vector<Column> columns;
+  Stream& output;
+  // The field separator, or zero if fields are only separated
+  // by whitespace, in which case records may span lines.
+  const char delimiter;
+  // Whether to pad columns and records as a C struct would be.
+  const bool aligned;
+  size_t alignment;
+  // If nonzero, columns are written one after another, each
+  // starting at a multiple of this many bytes.
+  size_t boundary;
+  size_t next;
+  uint64_t offset;
+  size_t fields;
+  bool after_field;
+  // Whether a comment continues into the next block read, and
+  // how much of the current line earlier blocks held.
+  bool commented;
+  size_t carried;
+  unsigned int line;
+  unsigned int column;
+};
+
+#endif
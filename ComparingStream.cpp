@@ -0,0 +1,250 @@
+#include <ComparingStream.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t block_size = 1 << 16;
+
+// Reads 'size' bytes at 'offset', unless the file ends first.
+bool read_fully(const int file, char* data, size_t size, uint64_t offset) {
+  while (size) {
+    const auto result = pread(file, data, size, offset);
+    if (result <= 0) {
+      if (result == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    data += result;
+    size -= result;
+    offset += result;
+  }
+  return true;
+}
+
+}
+
+different_output::different_output(const std::string& path,
+  const uint64_t offset)
+  : runtime_error(join("Output differs from '", path, "' at offset ",
+    offset, ".")) {}
+
+// A file to verify must exist, but one that is only replaced
+// if it has changed is simply created if it doesn't.
+ComparingBuffer::ComparingBuffer(const char* const path, const Mode mode,
+  const bool asynchronous, const bool direct)
+  : path(path), mode(mode), asynchronous(asynchronous), direct(direct),
+    file(open(path, O_RDONLY)), expected_offset(0), offset(0),
+    differs(false), seeked(false) {
+  if (file == -1 && (mode == VERIFY || errno != ENOENT))
+    throw std::runtime_error(join("Unable to open file to compare: '",
+      path, "'."));
+}
+
+// Unless it was finished, the output is abandoned, leaving the
+// original file as it was.
+ComparingBuffer::~ComparingBuffer() {
+  if (replacement) {
+    replacement.reset();
+    std::remove(temporary.c_str());
+  }
+  if (file != -1)
+    close(file);
+}
+
+// Checks that the file didn't continue past the output, and
+// replaces it if the output differs. Output that seeked may
+// have differed only until it went back over the difference.
+void ComparingBuffer::finish() {
+  if (error)
+    std::rethrow_exception(error);
+  if (!differs) {
+    struct stat status;
+    const uint64_t size
+      = file != -1 && fstat(file, &status) == 0 ? status.st_size : 0;
+    if (file == -1 || size != offset)
+      differ(std::min(size, offset));
+    if (error)
+      std::rethrow_exception(error);
+  }
+  if (!replacement)
+    return;
+  replacement->flush();
+  const bool written = bool(*replacement);
+  replacement.reset();
+  if (written && seeked && unchanged()) {
+    std::remove(temporary.c_str());
+    return;
+  }
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error(join("Unable to write output file: '", path,
+      "'."));
+  }
+}
+
+// Output is compared as it is written, unbuffered, so that a
+// difference is found as soon as it is written.
+ComparingBuffer::int_type ComparingBuffer::overflow(const int_type character) {
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    const char data = traits_type::to_char_type(character);
+    compare(&data, 1);
+  }
+  return traits_type::not_eof(character);
+}
+
+std::streamsize ComparingBuffer::xsputn(const char* const data,
+  const std::streamsize size) {
+  compare(data, size);
+  return size;
+}
+
+// Verified output isn't seekable. Otherwise, the first seek
+// starts the replacement, as if the output differed there, and
+// it and any later seek move within the replacement.
+ComparingBuffer::pos_type ComparingBuffer::seekoff(const off_type distance,
+  const std::ios_base::seekdir direction, const std::ios_base::openmode) {
+  if (mode == VERIFY || error)
+    return pos_type(off_type(-1));
+  if (!differs)
+    differ(offset);
+  seeked = true;
+  const auto result = replacement->rdbuf()->pubseekoff(distance, direction,
+    std::ios_base::out);
+  if (result != pos_type(off_type(-1)))
+    offset = result;
+  return result;
+}
+
+ComparingBuffer::pos_type ComparingBuffer::seekpos
+  (const pos_type position, const std::ios_base::openmode mode) {
+  return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
+// Flushes may happen on other threads, so errors are only
+// thrown by 'finish'.
+int ComparingBuffer::sync() {
+  try {
+    if (replacement)
+      replacement->flush();
+  } catch (...) {
+    if (!error)
+      error = std::current_exception();
+  }
+  return 0;
+}
+
+// Compares output with the file a block at a time. Once they
+// differ, verifying stops, and otherwise output goes to the
+// replacement.
+void ComparingBuffer::compare(const char* data, size_t size) {
+  if (error)
+    return;
+  while (size && !differs) {
+    if (offset < expected_offset
+      || offset >= expected_offset + expected.size()) {
+      expected.resize(block_size);
+      ssize_t result;
+      do {
+        result = file == -1 ? 0
+          : pread(file, &expected[0], expected.size(), offset);
+      } while (result == -1 && errno == EINTR);
+      if (result == -1)
+        fail(std::runtime_error
+          (join("Unable to read file to compare: '", path, "'.")));
+      expected.resize(result);
+      expected_offset = offset;
+      if (expected.empty()) {
+        differ(offset);
+        break;
+      }
+    }
+    const auto begin = expected.begin() + (offset - expected_offset);
+    const auto count = std::min<size_t>(size, expected.end() - begin);
+    const auto found = std::mismatch(data, data + count, begin);
+    const size_t same = found.first - data;
+    offset += same;
+    data += same;
+    size -= same;
+    if (same != count)
+      differ(offset);
+  }
+  if (!differs || !size)
+    return;
+  if (replacement)
+    replacement->write(data, size);
+  offset += size;
+}
+
+// Verifying, a difference is an error. Otherwise, the bytes
+// before it are copied from the file to the replacement,
+// directly where possible.
+void ComparingBuffer::differ(const uint64_t at) {
+  differs = true;
+  if (mode == VERIFY)
+    fail(different_output(path, at));
+  temporary = join(path, '.', getpid());
+  const auto output = open(temporary.c_str(),
+    O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (output == -1)
+    fail(std::runtime_error
+      (join("Unable to open output file: '", temporary, "'.")));
+  struct stat status;
+  if (file != -1 && fstat(file, &status) == 0)
+    fchmod(output, status.st_mode & 07777);
+  replacement.reset(new FileStream(output, true, asynchronous, direct));
+  auto& buffer = static_cast<FileBuffer&>(*replacement->rdbuf());
+  uint64_t copied = buffer.copy_from(file, 0, at);
+  while (copied < at) {
+    expected.resize(block_size);
+    const auto result = pread(file, &expected[0],
+      std::min<uint64_t>(expected.size(), at - copied), copied);
+    if (result <= 0) {
+      if (result == -1 && errno == EINTR)
+        continue;
+      fail(std::runtime_error
+        (join("Unable to read file to compare: '", path, "'.")));
+    }
+    replacement->write(&expected[0], result);
+    copied += result;
+  }
+  expected.clear();
+}
+
+// Whether the finished replacement is identical to the file.
+bool ComparingBuffer::unchanged() {
+  const auto written = open(temporary.c_str(), O_RDONLY);
+  struct stat original, status;
+  bool same = file != -1 && written != -1 && fstat(file, &original) == 0
+    && fstat(written, &status) == 0 && original.st_size == status.st_size;
+  std::vector<char> actual(block_size);
+  expected.resize(block_size);
+  for (uint64_t at = 0; same && at < uint64_t(status.st_size);
+    at += block_size) {
+    const auto size = std::min<uint64_t>(block_size, status.st_size - at);
+    same = read_fully(file, &expected[0], size, at)
+      && read_fully(written, &actual[0], size, at)
+      && std::equal(&actual[0], &actual[0] + size, &expected[0]);
+  }
+  expected.clear();
+  if (written != -1)
+    close(written);
+  return same;
+}
+
+// Keeps the first error to be thrown again by 'finish', in
+// case this one is lost in a flush.
+template<class Error>
+void ComparingBuffer::fail(const Error& failure) {
+  error = std::make_exception_ptr(failure);
+  throw failure;
+}
@@ -0,0 +1,82 @@
+#ifndef PROTODATA_COMPARINGSTREAM_H
+#define PROTODATA_COMPARINGSTREAM_H
+
+#include <FileStream.h>
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// An output buffer that compares everything written to it
+// with an existing file, without writing to it. Verifying,
+// the first difference is an error. Otherwise, output from
+// the first difference on is written to a temporary file,
+// which 'finish' renames over the original, so that output
+// identical to the file leaves it untouched. Only output that
+// isn't verified is seekable, within its replacement.
+class ComparingBuffer : public std::streambuf {
+public:
+  enum Mode {
+    VERIFY,
+    WRITE_IF_CHANGED,
+  };
+  ComparingBuffer(const char*, Mode, bool = false, bool = false);
+  ComparingBuffer(const ComparingBuffer&) = delete;
+  ComparingBuffer& operator=(const ComparingBuffer&) = delete;
+  ~ComparingBuffer();
+  void finish();
+protected:
+  int_type overflow(int_type) override;
+  std::streamsize xsputn(const char*, std::streamsize) override;
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+    std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+  int sync() override;
+private:
+  void compare(const char*, size_t);
+  void differ(uint64_t);
+  bool unchanged();
+  template<class Error>
+  void fail(const Error&);
+  const std::string path;
+  const Mode mode;
+  const bool asynchronous;
+  const bool direct;
+  int file;
+  // A block of the file from 'expected_offset'.
+  std::vector<char> expected;
+  uint64_t expected_offset;
+  uint64_t offset;
+  bool differs;
+  bool seeked;
+  std::exception_ptr error;
+  std::string temporary;
+  std::unique_ptr<FileStream> replacement;
+};
+
+// A difference between output and its file. It may be found
+// long after the term that wrote it, so it is reported by its
+// offset alone, and not in the context of an input.
+struct different_output : std::runtime_error {
+  different_output(const std::string& path, uint64_t offset);
+};
+
+// Differences and errors are thrown from writes, as well as
+// from 'finish', but not from flushes.
+class ComparingStream : public std::ostream {
+public:
+  explicit ComparingStream(const std::shared_ptr<ComparingBuffer>& buffer)
+    : std::ostream(nullptr), buffer(buffer) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+  }
+private:
+  std::shared_ptr<ComparingBuffer> buffer;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <CompressedStream.h>
+
+#include <compress.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const uint32_t lz4_magic = 0x184d2204;
+// Version 1, independent blocks, with a content checksum.
+const uint8_t lz4_flags = 0x64;
+// Blocks of at most 4 MiB.
+const uint8_t lz4_block_descriptor = 0x70;
+const size_t lz4_block_size = 4 << 20;
+// Set in the size of a block that is stored uncompressed.
+const uint32_t lz4_uncompressed = 0x80000000u;
+
+const size_t zstd_block_size = 1 << 20;
+
+void append32(std::vector<uint8_t>& output, const uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    output.push_back(uint8_t(value >> (i * 8)));
+}
+
+// A block prefixed by its size, stored as is if it doesn't
+// compress.
+std::vector<uint8_t> compress_block(const std::vector<uint8_t> input) {
+  std::vector<uint8_t> output(4 + lz4_bound(input.size()));
+  auto size = lz4_compress(&input[0], input.size(), &output[4]);
+  uint32_t header = size;
+  if (size >= input.size()) {
+    size = input.size();
+    header = size | lz4_uncompressed;
+    std::copy(input.begin(), input.end(), &output[4]);
+  }
+  output.resize(4 + size);
+  for (int i = 0; i < 4; ++i)
+    output[i] = uint8_t(header >> (i * 8));
+  return output;
+}
+
+}
+
+CompressedBuffer::CompressedBuffer
+  (std::unique_ptr<std::ostream, ostream_deleter>&& sink,
+    const Format format)
+  : sink(std::move(sink)), format(format),
+    block(format == LZ4 ? lz4_block_size : zstd_block_size),
+    workers(std::max(1u, std::thread::hardware_concurrency())),
+    digest(Term::XXH32) {
+  setp(reinterpret_cast<char*>(&block[0]),
+    reinterpret_cast<char*>(&block[0]) + block.size());
+#ifdef PROTODATA_ZSTD
+  context = nullptr;
+  if (format == ZSTD) {
+    context = ZSTD_createCCtx();
+    // Fails harmlessly where zstd is built without threads.
+    ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, int(workers));
+    return;
+  }
+#endif
+  std::vector<uint8_t> header;
+  append32(header, lz4_magic);
+  header.push_back(lz4_flags);
+  header.push_back(lz4_block_descriptor);
+  Digest check(Term::XXH32);
+  check.update(&header[4], 2);
+  header.push_back(uint8_t(check.value() >> 8));
+  put(header);
+}
+
+// Ends the frame with an empty block and the checksum of
+// everything written.
+CompressedBuffer::~CompressedBuffer() {
+  submit();
+  drain(0);
+#ifdef PROTODATA_ZSTD
+  if (format == ZSTD) {
+    compress_zstd(0, ZSTD_e_end);
+    ZSTD_freeCCtx(context);
+    sink->flush();
+    return;
+  }
+#endif
+  std::vector<uint8_t> trailer;
+  append32(trailer, 0);
+  append32(trailer, uint32_t(digest.value()));
+  put(trailer);
+  sink->flush();
+}
+
+CompressedBuffer::int_type CompressedBuffer::overflow
+  (const int_type character) {
+  submit();
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(character);
+    pbump(1);
+  }
+  return traits_type::not_eof(character);
+}
+
+std::streamsize CompressedBuffer::xsputn
+  (const char* data, const std::streamsize size) {
+  auto remaining = size;
+  while (remaining > 0) {
+    if (pptr() == epptr())
+      submit();
+    const auto chunk = std::min<std::streamsize>
+      (remaining, epptr() - pptr());
+    std::memcpy(pptr(), data, chunk);
+    pbump(chunk);
+    data += chunk;
+    remaining -= chunk;
+  }
+  return size;
+}
+
+// Flushing ends the current block early, so that everything
+// written so far can be decompressed.
+int CompressedBuffer::sync() {
+  submit();
+  drain(0);
+#ifdef PROTODATA_ZSTD
+  if (format == ZSTD)
+    compress_zstd(0, ZSTD_e_flush);
+#endif
+  sink->flush();
+  return *sink ? 0 : -1;
+}
+
+// Hands the current block to a worker, waiting for the
+// oldest one to finish if all are busy.
+void CompressedBuffer::submit() {
+  const size_t size = pptr() - pbase();
+  if (size == 0)
+    return;
+#ifdef PROTODATA_ZSTD
+  if (format == ZSTD) {
+    compress_zstd(size, ZSTD_e_continue);
+    setp(pbase(), epptr());
+    return;
+  }
+#endif
+  block.resize(size);
+  digest.update(&block[0], size);
+  drain(workers - 1);
+  pending.push_back
+    (std::async(std::launch::async, compress_block, std::move(block)));
+  block = std::vector<uint8_t>(lz4_block_size);
+  setp(reinterpret_cast<char*>(&block[0]),
+    reinterpret_cast<char*>(&block[0]) + block.size());
+}
+
+// Writes compressed blocks in order until at most 'limit'
+// are still in progress.
+void CompressedBuffer::drain(const size_t limit) {
+  while (pending.size() > limit) {
+    put(pending.front().get());
+    pending.pop_front();
+  }
+}
+
+void CompressedBuffer::put(const std::vector<uint8_t>& data) {
+  sink->write(reinterpret_cast<const char*>(&data[0]), data.size());
+}
+
+#ifdef PROTODATA_ZSTD
+// Compresses 'size' bytes of the block, then for other than
+// ZSTD_e_continue, flushes or ends the frame.
+void CompressedBuffer::compress_zstd(const size_t size,
+  const ZSTD_EndDirective directive) {
+  ZSTD_inBuffer input = { &block[0], size, 0 };
+  std::vector<uint8_t> output(ZSTD_CStreamOutSize());
+  size_t remaining;
+  do {
+    ZSTD_outBuffer out = { &output[0], output.size(), 0 };
+    remaining = ZSTD_compressStream2(context, &out, &input, directive);
+    if (ZSTD_isError(remaining))
+      throw std::runtime_error(ZSTD_getErrorName(remaining));
+    sink->write(reinterpret_cast<const char*>(&output[0]), out.pos);
+  } while (directive == ZSTD_e_continue
+    ? input.pos < input.size : remaining != 0);
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef PROTODATA_COMPRESSEDSTREAM_H
+#define PROTODATA_COMPRESSEDSTREAM_H
+
+#include <Digest.h>
+#include <deleters.h>
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+#ifdef PROTODATA_ZSTD
+#include <zstd.h>
+#endif
+
+// An output buffer that compresses everything written to it
+// into another stream, as a standard LZ4 frame or, in builds
+// with zstd, a zstd frame. LZ4 blocks are independent, and
+// are compressed on worker threads while output continues;
+// zstd uses its own workers. The output is not seekable.
+class CompressedBuffer : public std::streambuf {
+public:
+  enum Format {
+    LZ4,
+    ZSTD,
+  };
+  CompressedBuffer(std::unique_ptr<std::ostream, ostream_deleter>&&,
+    Format);
+  CompressedBuffer(const CompressedBuffer&) = delete;
+  CompressedBuffer& operator=(const CompressedBuffer&) = delete;
+  ~CompressedBuffer();
+protected:
+  int_type overflow(int_type) override;
+  std::streamsize xsputn(const char*, std::streamsize) override;
+  int sync() override;
+private:
+  void submit();
+  void drain(size_t);
+  void put(const std::vector<uint8_t>&);
+  std::unique_ptr<std::ostream, ostream_deleter> sink;
+  const Format format;
+  std::vector<uint8_t> block;
+  std::deque<std::future<std::vector<uint8_t>>> pending;
+  size_t workers;
+  Digest digest;
+#ifdef PROTODATA_ZSTD
+  void compress_zstd(size_t, ZSTD_EndDirective);
+  ZSTD_CCtx* context;
+#endif
+};
+
+class CompressedStream : public std::ostream {
+public:
+  CompressedStream(std::unique_ptr<std::ostream, ostream_deleter>&& sink,
+    CompressedBuffer::Format format)
+    : std::ostream(nullptr), buffer(std::move(sink), format) {
+    rdbuf(&buffer);
+  }
+private:
+  CompressedBuffer buffer;
+};
+
+#endif
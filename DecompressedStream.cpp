@@ -0,0 +1,210 @@
+#include <DecompressedStream.h>
+
+#include <util.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef PROTODATA_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+const size_t input_block_size = 1 << 18;
+const size_t output_block_size = 1 << 20;
+// Blocks decompressed ahead of the reader.
+const size_t ready_limit = 4;
+
+const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+}
+
+// Takes ownership of the descriptor.
+DecompressedBuffer::DecompressedBuffer(const int file, const Format format)
+  : file(file), format(format), finished(false), stopping(false) {
+  setg(nullptr, nullptr, nullptr);
+  worker = std::thread(&DecompressedBuffer::run, this);
+}
+
+DecompressedBuffer::~DecompressedBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  worker.join();
+  close(file);
+}
+
+// Detects a compressed file by its magic number, without
+// moving its offset.
+bool DecompressedBuffer::detect(const int file, Format& format) {
+  unsigned char magic[4];
+  const auto size = pread(file, magic, sizeof(magic), 0);
+  if (size >= 2 && std::memcmp(magic, gzip_magic, 2) == 0) {
+    format = GZIP;
+    return true;
+  }
+  if (size == 4 && std::memcmp(magic, zstd_magic, 4) == 0) {
+    format = ZSTD;
+    return true;
+  }
+  return false;
+}
+
+DecompressedBuffer::int_type DecompressedBuffer::underflow() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return !ready.empty() || finished; });
+  if (ready.empty()) {
+    if (error)
+      std::rethrow_exception(error);
+    return traits_type::eof();
+  }
+  current = std::move(ready.front());
+  ready.pop_front();
+  lock.unlock();
+  changed.notify_all();
+  setg(&current[0], &current[0], &current[0] + current.size());
+  return traits_type::to_int_type(current[0]);
+}
+
+void DecompressedBuffer::run() {
+  try {
+    if (format == GZIP)
+      inflate_gzip();
+    else
+      decompress_zstd();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  changed.notify_all();
+}
+
+// Concatenated gzip members are decompressed one after
+// another, as by 'zcat'.
+void DecompressedBuffer::inflate_gzip() {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    throw std::runtime_error("Unable to start gzip decompression.");
+  struct Ender {
+    z_stream& stream;
+    ~Ender() { inflateEnd(&stream); }
+  } ender = { stream };
+  std::vector<unsigned char> input(input_block_size);
+  bool eof = false, ended = false, done = false;
+  while (!done) {
+    std::vector<char> block(output_block_size);
+    stream.next_out = reinterpret_cast<Bytef*>(&block[0]);
+    stream.avail_out = block.size();
+    while (stream.avail_out > 0) {
+      if (stream.avail_in == 0 && !eof) {
+        stream.avail_in = read_some(input);
+        stream.next_in = &input[0];
+        eof = stream.avail_in == 0;
+      }
+      if (ended && stream.avail_in > 0) {
+        inflateReset(&stream);
+        ended = false;
+      }
+      const auto before = stream.avail_out;
+      const auto result = ended ? Z_BUF_ERROR : inflate(&stream, Z_NO_FLUSH);
+      if (result == Z_STREAM_END) {
+        ended = true;
+      } else if (result == Z_BUF_ERROR) {
+        if (eof && stream.avail_out == before) {
+          done = true;
+          break;
+        }
+      } else if (result != Z_OK) {
+        throw std::runtime_error(join("Invalid gzip data: ",
+          stream.msg ? stream.msg : "unknown error", "."));
+      }
+    }
+    block.resize(block.size() - stream.avail_out);
+    if (!block.empty() && !push(std::move(block)))
+      return;
+  }
+  if (!ended)
+    throw std::runtime_error("Unexpected end of gzip data.");
+}
+
+#ifdef PROTODATA_ZSTD
+void DecompressedBuffer::decompress_zstd() {
+  const auto context = ZSTD_createDCtx();
+  struct Freer {
+    ZSTD_DCtx* context;
+    ~Freer() { ZSTD_freeDCtx(context); }
+  } freer = { context };
+  std::vector<unsigned char> buffer(input_block_size);
+  ZSTD_inBuffer input = { &buffer[0], 0, 0 };
+  size_t hint = 0;
+  bool eof = false, done = false;
+  while (!done) {
+    std::vector<char> block(output_block_size);
+    ZSTD_outBuffer output = { &block[0], block.size(), 0 };
+    while (output.pos < output.size) {
+      if (input.pos == input.size && !eof) {
+        input.size = read_some(buffer);
+        input.pos = 0;
+        eof = input.size == 0;
+      }
+      const auto before = output.pos;
+      const auto result = ZSTD_decompressStream(context, &output, &input);
+      if (ZSTD_isError(result))
+        throw std::runtime_error(join("Invalid zstd data: ",
+          ZSTD_getErrorName(result), "."));
+      // Past the end, the result only hints at another frame.
+      if (eof && output.pos == before) {
+        done = true;
+        break;
+      }
+      hint = result;
+    }
+    block.resize(output.pos);
+    if (!block.empty() && !push(std::move(block)))
+      return;
+  }
+  if (hint != 0)
+    throw std::runtime_error("Unexpected end of zstd data.");
+}
+#else
+void DecompressedBuffer::decompress_zstd() {
+  throw std::runtime_error("zstd input is not supported in this build.");
+}
+#endif
+
+size_t DecompressedBuffer::read_some(std::vector<unsigned char>& buffer) {
+  while (true) {
+    const auto result = read(file, &buffer[0], buffer.size());
+    if (result != -1)
+      return result;
+    if (errno != EINTR)
+      throw std::runtime_error("Unable to read compressed input.");
+  }
+}
+
+// Waits for room for another block, returning false if the
+// reader has gone away.
+bool DecompressedBuffer::push(std::vector<char>&& block) {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock,
+    [this] { return ready.size() < ready_limit || stopping; });
+  if (stopping)
+    return false;
+  ready.push_back(std::move(block));
+  lock.unlock();
+  changed.notify_all();
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef PROTODATA_DECOMPRESSEDSTREAM_H
+#define PROTODATA_DECOMPRESSEDSTREAM_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+// An input buffer over a gzip or, in builds with zstd, a zstd
+// file, which is read and decompressed on its own thread in
+// blocks, a few ahead of where the input is being read.
+class DecompressedBuffer : public std::streambuf {
+public:
+  enum Format {
+    GZIP,
+    ZSTD,
+  };
+  DecompressedBuffer(int, Format);
+  DecompressedBuffer(const DecompressedBuffer&) = delete;
+  DecompressedBuffer& operator=(const DecompressedBuffer&) = delete;
+  ~DecompressedBuffer();
+  static bool detect(int, Format&);
+protected:
+  int_type underflow() override;
+private:
+  void run();
+  void inflate_gzip();
+  void decompress_zstd();
+  size_t read_some(std::vector<unsigned char>&);
+  bool push(std::vector<char>&&);
+  const int file;
+  const Format format;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<char>> ready;
+  std::vector<char> current;
+  bool finished;
+  bool stopping;
+  std::exception_ptr error;
+  std::thread worker;
+};
+
+// Errors in the compressed data are thrown from reads.
+class DecompressedStream : public std::istream {
+public:
+  DecompressedStream(int descriptor, DecompressedBuffer::Format format)
+    : std::istream(nullptr), buffer(descriptor, format) {
+    rdbuf(&buffer);
+    exceptions(std::ios::badbit);
+  }
+private:
+  DecompressedBuffer buffer;
+};
+
+#endif
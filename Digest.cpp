@@ -0,0 +1,287 @@
+#include <Digest.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+// Tables for slicing-by-8 CRC computation, where 'tables[k]'
+// gives the CRC of a byte followed by 'k' zero bytes.
+typedef std::array<std::array<uint32_t, 256>, 8> CrcTables;
+
+CrcTables crc_tables(const uint32_t polynomial) {
+  CrcTables tables;
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+    tables[0][i] = crc;
+  }
+  for (size_t k = 1; k < tables.size(); ++k)
+    for (uint32_t i = 0; i < 256; ++i)
+      tables[k][i] = (tables[k - 1][i] >> 8)
+        ^ tables[0][tables[k - 1][i] & 0xff];
+  return tables;
+}
+
+const CrcTables crc32_tables = crc_tables(0xedb88320);
+const CrcTables crc32c_tables = crc_tables(0x82f63b78);
+
+uint32_t read32(const uint8_t* const data) {
+  return uint32_t(data[0]) | uint32_t(data[1]) << 8
+    | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+uint64_t read64(const uint8_t* const data) {
+  return uint64_t(read32(data)) | uint64_t(read32(data + 4)) << 32;
+}
+
+uint32_t crc_update(const CrcTables& tables, uint32_t crc,
+  const uint8_t* data, size_t size) {
+  for (; size >= 8; data += 8, size -= 8) {
+    const uint32_t low = crc ^ read32(data);
+    crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff]
+      ^ tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24]
+      ^ tables[3][data[4]] ^ tables[2][data[5]]
+      ^ tables[1][data[6]] ^ tables[0][data[7]];
+  }
+  for (; size > 0; ++data, --size)
+    crc = tables[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t* data, size_t size) {
+  uint64_t wide = crc;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = wide;
+  for (; size > 0; ++data, --size)
+    crc = _mm_crc32_u8(crc, *data);
+  return crc;
+}
+
+const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+
+#endif
+
+uint32_t crc32c_update(const uint32_t crc, const uint8_t* const data,
+  const size_t size) {
+#if defined(__x86_64__)
+  if (has_sse42)
+    return crc32c_update_sse42(crc, data, size);
+#endif
+  return crc_update(crc32c_tables, crc, data, size);
+}
+
+// Adler-32 sums can be deferred for this many bytes before
+// reducing them modulo 65521 without overflowing 32 bits.
+const size_t adler32_block = 5552;
+
+template<class T>
+T rotate_left(const T value, const int bits) {
+  return (value << bits) | (value >> (sizeof(T) * 8 - bits));
+}
+
+const uint32_t xxh32_primes[] = {
+  2654435761u, 2246822519u, 3266489917u, 668265263u, 374761393u,
+};
+
+const uint64_t xxh64_primes[] = {
+  11400714785074694791ull, 14029467366897019727ull,
+  1609587929392839161ull, 9650029242287828579ull,
+  2870177450012600261ull,
+};
+
+uint32_t xxh32_round(const uint32_t accumulator, const uint32_t input) {
+  return rotate_left(accumulator + input * xxh32_primes[1], 13)
+    * xxh32_primes[0];
+}
+
+uint64_t xxh64_round(const uint64_t accumulator, const uint64_t input) {
+  return rotate_left(accumulator + input * xxh64_primes[1], 31)
+    * xxh64_primes[0];
+}
+
+uint64_t xxh64_merge(const uint64_t hash, const uint64_t accumulator) {
+  return (hash ^ xxh64_round(0, accumulator)) * xxh64_primes[0]
+    + xxh64_primes[3];
+}
+
+}
+
+Digest::Digest(const Term::Checksum algorithm)
+  : algorithm(algorithm), length(0) {
+  switch (algorithm) {
+  case Term::CRC32:
+  case Term::CRC32C:
+    state[0] = 0xffffffff;
+    break;
+  case Term::ADLER32:
+    state[0] = 1;
+    state[1] = 0;
+    break;
+  case Term::XXH32:
+    state[0] = uint32_t(xxh32_primes[0] + xxh32_primes[1]);
+    state[1] = xxh32_primes[1];
+    state[2] = 0;
+    state[3] = uint32_t(-xxh32_primes[0]);
+    break;
+  case Term::XXH64:
+    state[0] = xxh64_primes[0] + xxh64_primes[1];
+    state[1] = xxh64_primes[1];
+    state[2] = 0;
+    state[3] = -xxh64_primes[0];
+    break;
+  }
+}
+
+size_t Digest::size(const Term::Checksum algorithm) {
+  return algorithm == Term::XXH64 ? 8 : 4;
+}
+
+void Digest::update(const uint8_t* data, size_t size) {
+  const auto total = size;
+  switch (algorithm) {
+  case Term::CRC32:
+    state[0] = crc_update(crc32_tables, state[0], data, size);
+    break;
+  case Term::CRC32C:
+    state[0] = crc32c_update(state[0], data, size);
+    break;
+  case Term::ADLER32:
+    while (size > 0) {
+      const auto block = std::min(size, adler32_block);
+      uint32_t a = state[0], b = state[1];
+      for (size_t i = 0; i < block; ++i) {
+        a += data[i];
+        b += a;
+      }
+      state[0] = a % 65521;
+      state[1] = b % 65521;
+      data += block;
+      size -= block;
+    }
+    break;
+  case Term::XXH32:
+    update_xxh32(data, size);
+    break;
+  case Term::XXH64:
+    update_xxh64(data, size);
+    break;
+  }
+  length += total;
+}
+
+// The xxHash functions consume input in stripes of four
+// words, keeping any partial stripe until more input comes.
+
+void Digest::update_xxh32(const uint8_t* data, size_t size) {
+  const size_t stripe = 16;
+  const size_t buffered = length % stripe;
+  if (buffered + size < stripe) {
+    std::copy(data, data + size, &pending[buffered]);
+    return;
+  }
+  if (buffered != 0) {
+    const auto filled = stripe - buffered;
+    std::copy(data, data + filled, &pending[buffered]);
+    for (int i = 0; i < 4; ++i)
+      state[i] = xxh32_round(state[i], read32(&pending[4 * i]));
+    data += filled;
+    size -= filled;
+  }
+  for (; size >= stripe; data += stripe, size -= stripe)
+    for (int i = 0; i < 4; ++i)
+      state[i] = xxh32_round(state[i], read32(data + 4 * i));
+  std::copy(data, data + size, &pending[0]);
+}
+
+void Digest::update_xxh64(const uint8_t* data, size_t size) {
+  const size_t stripe = 32;
+  const size_t buffered = length % stripe;
+  if (buffered + size < stripe) {
+    std::copy(data, data + size, &pending[buffered]);
+    return;
+  }
+  if (buffered != 0) {
+    const auto filled = stripe - buffered;
+    std::copy(data, data + filled, &pending[buffered]);
+    for (int i = 0; i < 4; ++i)
+      state[i] = xxh64_round(state[i], read64(&pending[8 * i]));
+    data += filled;
+    size -= filled;
+  }
+  for (; size >= stripe; data += stripe, size -= stripe)
+    for (int i = 0; i < 4; ++i)
+      state[i] = xxh64_round(state[i], read64(data + 8 * i));
+  std::copy(data, data + size, &pending[0]);
+}
+
+uint64_t Digest::value() const {
+  switch (algorithm) {
+  case Term::CRC32:
+  case Term::CRC32C:
+    return uint32_t(~state[0]);
+  case Term::ADLER32:
+    return state[1] << 16 | state[0];
+  case Term::XXH32:
+    {
+      uint32_t hash = length >= 16
+        ? rotate_left(uint32_t(state[0]), 1)
+          + rotate_left(uint32_t(state[1]), 7)
+          + rotate_left(uint32_t(state[2]), 12)
+          + rotate_left(uint32_t(state[3]), 18)
+        : xxh32_primes[4];
+      hash += uint32_t(length);
+      const uint8_t* data = &pending[0];
+      const uint8_t* const end = data + length % 16;
+      for (; data + 4 <= end; data += 4)
+        hash = rotate_left(hash + read32(data) * xxh32_primes[2], 17)
+          * xxh32_primes[3];
+      for (; data < end; ++data)
+        hash = rotate_left(hash + *data * xxh32_primes[4], 11)
+          * xxh32_primes[0];
+      hash = (hash ^ (hash >> 15)) * xxh32_primes[1];
+      hash = (hash ^ (hash >> 13)) * xxh32_primes[2];
+      return hash ^ (hash >> 16);
+    }
+  case Term::XXH64:
+    {
+      uint64_t hash = xxh64_primes[4];
+      if (length >= 32) {
+        hash = rotate_left(state[0], 1) + rotate_left(state[1], 7)
+          + rotate_left(state[2], 12) + rotate_left(state[3], 18);
+        for (int i = 0; i < 4; ++i)
+          hash = xxh64_merge(hash, state[i]);
+      }
+      hash += length;
+      const uint8_t* data = &pending[0];
+      const uint8_t* const end = data + length % 32;
+      for (; data + 8 <= end; data += 8)
+        hash = rotate_left(hash ^ xxh64_round(0, read64(data)), 27)
+          * xxh64_primes[0] + xxh64_primes[3];
+      for (; data + 4 <= end; data += 4)
+        hash = rotate_left(hash ^ (read32(data) * xxh64_primes[0]), 23)
+          * xxh64_primes[1] + xxh64_primes[2];
+      for (; data < end; ++data)
+        hash = rotate_left(hash ^ (*data * xxh64_primes[4]), 11)
+          * xxh64_primes[0];
+      hash = (hash ^ (hash >> 33)) * xxh64_primes[1];
+      hash = (hash ^ (hash >> 29)) * xxh64_primes[2];
+      return hash ^ (hash >> 32);
+    }
+  }
+  IMPOSSIBLE("invalid checksum algorithm");
+}
@@ -0,0 +1,26 @@
+#ifndef PROTODATA_DIGEST_H
+#define PROTODATA_DIGEST_H
+
+#include <Term.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// An incrementally computed checksum of a run of bytes.
+class Digest {
+public:
+  explicit Digest(Term::Checksum);
+  void update(const uint8_t*, size_t);
+  uint64_t value() const;
+  static size_t size(Term::Checksum);
+private:
+  void update_xxh32(const uint8_t*, size_t);
+  void update_xxh64(const uint8_t*, size_t);
+  Term::Checksum algorithm;
+  std::array<uint64_t, 4> state;
+  uint64_t length;
+  std::array<uint8_t, 32> pending;
+};
+
+#endif
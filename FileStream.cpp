@@ -0,0 +1,297 @@
+#include <FileStream.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t block_size = 1 << 16;
+const size_t ring_block_size = 1 << 18;
+const size_t ring_slots = 4;
+
+// Direct writes must be aligned to the logical block size of
+// the device, which is at most a page in practice.
+const size_t direct_alignment = 4096;
+
+bool aligned(const uint64_t value) {
+  return value % direct_alignment == 0;
+}
+
+}
+
+FileBuffer::FileBuffer(const int file, const bool owned,
+  const bool asynchronous, const bool uncached)
+  : file(file), owned(owned), current(0), offset(0), direct(false),
+    failed(false) {
+  if (asynchronous || uncached)
+    start(uncached);
+  if (!ring) {
+    storage.resize(block_size);
+    const Slot slot = { &storage[0], false, 0, 0 };
+    slots.assign(1, slot);
+  }
+  setp(slots[0].data, slots[0].data + (ring ? ring_block_size : block_size));
+}
+
+FileBuffer::~FileBuffer() {
+  drain();
+  settle();
+  ring.reset();
+  if (owned)
+    close(file);
+}
+
+// Sets up io_uring for a regular file, if possible. Writes go
+// to explicit offsets, so the file must not be in append mode.
+void FileBuffer::start(const bool uncached) {
+  struct stat status;
+  const auto flags = fcntl(file, F_GETFL);
+  if (fstat(file, &status) == -1 || !S_ISREG(status.st_mode)
+    || flags == -1 || (flags & O_APPEND))
+    return;
+  const auto position = lseek(file, 0, SEEK_CUR);
+  if (position == -1)
+    return;
+  storage.resize(ring_slots * ring_block_size + direct_alignment);
+  auto base = &storage[0];
+  base += (direct_alignment
+    - reinterpret_cast<uintptr_t>(base) % direct_alignment)
+    % direct_alignment;
+  std::vector<iovec> buffers;
+  for (size_t i = 0; i < ring_slots; ++i) {
+    const Slot slot = { base + i * ring_block_size, false, 0, 0 };
+    slots.push_back(slot);
+    const iovec buffer = { slot.data, ring_block_size };
+    buffers.push_back(buffer);
+  }
+  try {
+    ring.reset(new Ring(file, buffers));
+  } catch (const std::runtime_error&) {
+    storage.clear();
+    slots.clear();
+    return;
+  }
+  offset = position;
+  if (uncached && aligned(offset))
+    set_direct(true);
+}
+
+// Copies from another descriptor without passing through
+// user space, trying 'copy_file_range' (file to file) and
+// then 'sendfile' (file to anything). Returns the number of
+// bytes copied, which is short if neither is supported.
+uint64_t FileBuffer::copy_from
+  (const int source, const uint64_t start, const uint64_t size) {
+  if (!drain() || !settle())
+    return 0;
+  if (direct)
+    set_direct(false);
+  loff_t position = start;
+  uint64_t copied = 0;
+  while (copied < size) {
+    const auto result = copy_file_range
+      (source, &position, file, nullptr, size - copied, 0);
+    if (result > 0) {
+      copied += result;
+      continue;
+    }
+    if (result == -1 && errno == EINTR)
+      continue;
+    break;
+  }
+  off_t sent = position;
+  while (copied < size) {
+    const auto result = sendfile(file, source, &sent, size - copied);
+    if (result > 0) {
+      copied += result;
+      continue;
+    }
+    if (result == -1 && errno == EINTR)
+      continue;
+    break;
+  }
+  if (ring) {
+    const auto position = lseek(file, 0, SEEK_CUR);
+    if (position == -1)
+      failed = true;
+    else
+      offset = position;
+  }
+  return copied;
+}
+
+FileBuffer::int_type FileBuffer::overflow(const int_type character) {
+  if (!drain())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(character);
+    pbump(1);
+  }
+  return traits_type::not_eof(character);
+}
+
+// Writes larger than the buffer go straight to the file,
+// unless writes are in flight, in which case they're queued.
+std::streamsize FileBuffer::xsputn
+  (const char* const data, const std::streamsize size) {
+  if (ring) {
+    std::streamsize written = 0;
+    while (written < size) {
+      if (pptr() == epptr() && !drain())
+        break;
+      const auto chunk = std::min<std::streamsize>
+        (size - written, epptr() - pptr());
+      std::memcpy(pptr(), data + written, chunk);
+      pbump(chunk);
+      written += chunk;
+    }
+    return written;
+  }
+  if (size <= epptr() - pptr()) {
+    std::memcpy(pptr(), data, size);
+    pbump(size);
+    return size;
+  }
+  if (!drain())
+    return 0;
+  if (size < epptr() - pptr()) {
+    std::memcpy(pptr(), data, size);
+    pbump(size);
+    return size;
+  }
+  return write_all(data, size) ? size : 0;
+}
+
+// Seeking past the end of the file leaves a hole, which is
+// sparse where the file system supports it.
+FileBuffer::pos_type FileBuffer::seekoff(const off_type distance,
+  const std::ios_base::seekdir direction, const std::ios_base::openmode) {
+  if (!drain() || !settle())
+    return pos_type(off_type(-1));
+  const auto result = lseek(file, distance,
+    direction == std::ios_base::beg ? SEEK_SET
+      : direction == std::ios_base::cur ? SEEK_CUR : SEEK_END);
+  if (result == -1)
+    return pos_type(off_type(-1));
+  offset = result;
+  return pos_type(result);
+}
+
+FileBuffer::pos_type FileBuffer::seekpos
+  (const pos_type position, const std::ios_base::openmode mode) {
+  return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
+int FileBuffer::sync() {
+  return drain() && settle() ? 0 : -1;
+}
+
+bool FileBuffer::drain() {
+  if (ring)
+    return submit();
+  const bool success = write_all(pbase(), pptr() - pbase());
+  setp(&storage[0], &storage[0] + storage.size());
+  return success;
+}
+
+// Starts writing the current buffer and moves to the next,
+// waiting for it if it's still being written.
+bool FileBuffer::submit() {
+  const size_t size = pptr() - pbase();
+  if (size == 0)
+    return !failed;
+  if (direct && (!aligned(size) || !aligned(offset)))
+    set_direct(false);
+  auto& slot = slots[current];
+  slot.busy = true;
+  slot.size = size;
+  slot.offset = offset;
+  try {
+    ring->write(current, slot.data, size, offset);
+  } catch (const std::runtime_error&) {
+    slot.busy = false;
+    failed = true;
+  }
+  offset += size;
+  current = (current + 1) % slots.size();
+  while (slots[current].busy)
+    complete();
+  setp(slots[current].data, slots[current].data + ring_block_size);
+  return !failed;
+}
+
+// Waits for all writes in flight, and moves the file position
+// past them, so that the file can be written to directly.
+bool FileBuffer::settle() {
+  if (!ring)
+    return !failed;
+  for (const auto& slot : slots)
+    while (slot.busy)
+      complete();
+  if (lseek(file, offset, SEEK_SET) == -1)
+    failed = true;
+  return !failed;
+}
+
+// Finishes one write, completing it synchronously if short.
+void FileBuffer::complete() {
+  Ring::Completion completion;
+  try {
+    completion = ring->wait();
+  } catch (const std::runtime_error&) {
+    for (auto& slot : slots)
+      slot.busy = false;
+    failed = true;
+    return;
+  }
+  auto& slot = slots[completion.buffer];
+  slot.busy = false;
+  if (completion.result < 0) {
+    failed = true;
+    return;
+  }
+  for (size_t done = completion.result; done < slot.size; ) {
+    const auto result = pwrite(file, slot.data + done, slot.size - done,
+      slot.offset + done);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result <= 0) {
+      failed = true;
+      return;
+    }
+    done += result;
+  }
+}
+
+// Direct writes must finish before the flag changes, since
+// it applies to writes that haven't started yet.
+void FileBuffer::set_direct(const bool enable) {
+  for (const auto& slot : slots)
+    while (slot.busy)
+      complete();
+  const auto flags = fcntl(file, F_GETFL);
+  if (flags != -1 && fcntl(file, F_SETFL,
+    enable ? flags | O_DIRECT : flags & ~O_DIRECT) == 0)
+    direct = enable;
+}
+
+bool FileBuffer::write_all(const char* data, size_t size) {
+  while (size > 0) {
+    const auto result = ::write(file, data, size);
+    if (result == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += result;
+    size -= result;
+  }
+  return true;
+}
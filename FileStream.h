@@ -0,0 +1,74 @@
+#ifndef PROTODATA_FILESTREAM_H
+#define PROTODATA_FILESTREAM_H
+
+#include <Ring.h>
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// An output buffer over a POSIX file descriptor, so that
+// the descriptor is available for zero-copy transfers.
+//
+// Asynchronous buffers write regular files through io_uring,
+// rotating among several buffers so that filling one overlaps
+// writing the others, and direct ones bypass the page cache
+// for as long as writes stay aligned. Either falls back to
+// ordinary writes where it isn't supported.
+class FileBuffer : public std::streambuf {
+public:
+  FileBuffer(int, bool, bool = false, bool = false);
+  FileBuffer(const FileBuffer&) = delete;
+  FileBuffer& operator=(const FileBuffer&) = delete;
+  ~FileBuffer();
+  int descriptor() const { return file; }
+  bool asynchronous() const { return bool(ring); }
+  uint64_t copy_from(int, uint64_t, uint64_t);
+protected:
+  int_type overflow(int_type) override;
+  std::streamsize xsputn(const char*, std::streamsize) override;
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+    std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+  int sync() override;
+private:
+  // A buffer and the write, if any, in progress from it.
+  struct Slot {
+    char* data;
+    bool busy;
+    size_t size;
+    uint64_t offset;
+  };
+  void start(bool);
+  bool drain();
+  bool submit();
+  bool settle();
+  void complete();
+  void set_direct(bool);
+  bool write_all(const char*, size_t);
+  const int file;
+  const bool owned;
+  std::unique_ptr<Ring> ring;
+  std::vector<char> storage;
+  std::vector<Slot> slots;
+  size_t current;
+  uint64_t offset;
+  bool direct;
+  bool failed;
+};
+
+class FileStream : public std::ostream {
+public:
+  FileStream(int descriptor, bool owned,
+    bool asynchronous = false, bool direct = false)
+    : std::ostream(nullptr),
+      buffer(descriptor, owned, asynchronous, direct) {
+    rdbuf(&buffer);
+  }
+private:
+  FileBuffer buffer;
+};
+
+#endif
@@ -1,52 +1,441 @@
 #include <Interpreter.h>
 
+#include <Stats.h>
+#include <generate.h>
 #include <write.h>
 
+#include <util.h>
+
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+template<class T>
+void place_checksum(T, Term::Endianness, size_t, Term::Placement, Stream&);
+template<class T>
+void place_size(uint64_t, bool, Term::Endianness, size_t, Stream&);
+
+}
+
 Interpreter::Interpreter(std::ostream& output)
-  : output(output) {
+  : expecting_region(false), self_contained(true), holes(nullptr),
+    next_hole(nullptr) {
+  add_section(std::string(), &output);
+  this->output = sections[std::string()].stream.get();
+  state.push(State());
+}
+
+// An interpreter that only checks its input and counts the
+// size of its output, without writing anything.
+Interpreter::Interpreter()
+  : expecting_region(false), self_contained(true), holes(nullptr),
+    next_hole(nullptr) {
+  add_section(std::string(), nullptr);
+  output = sections[std::string()].stream.get();
   state.push(State());
 }
 
+// Adds a named section, written to 'sink', or only counted
+// if it's null.
+void Interpreter::add_section(const std::string& name,
+  std::ostream* const sink) {
+  if (sections.count(name))
+    throw std::runtime_error(join("Duplicate section: '", name, "'."));
+  Section& added = sections[name];
+  added.stream.reset(sink ? new Stream(*sink) : new Stream());
+  added.sink = sink;
+}
+
 Interpreter::State::State() :
   width(sizeof(int) * 8),
   endianness(Term::NATIVE),
   signedness(Term::UNSIGNED),
-  format(Term::INTEGER) {}
+  format(Term::INTEGER),
+  reference(Term::ABSOLUTE) {}
+
+Interpreter::Base::Base() : reference(Term::ABSOLUTE), value(0) {}
 
 void Interpreter::run(const std::vector<Term>& terms) {
+  STATS_PHASE(ENCODE);
   for (auto term : terms) {
+    STATS(terms[term.type]++);
+    if (term.type == Term::WRITE_SIGNED || term.type == Term::WRITE_UNSIGNED
+      || term.type == Term::WRITE_DOUBLE)
+      STATS(values[state.top().format][state.top().width]++);
+    if (expecting_region && term.type != Term::PUSH)
+      throw std::runtime_error(next_region.type == Term::AT
+        ? "Expected '{' after 'at'."
+        : next_region.type == Term::SECTION
+          ? "Expected '{' after 'section'." : "Expected '{' after checksum.");
+    if (next_hole) {
+      write_hole(term);
+      continue;
+    }
     switch (term.type) {
     case Term::NOOP:
       break;
     case Term::PUSH:
-      state.push(state.top());
+      state.push();
+      STATS(reach(state.size()));
+      if (expecting_region)
+        begin_region();
       break;
     case Term::POP:
       if (state.size() <= 1)
         throw std::runtime_error("Mismatched braces.");
       state.pop();
+      if (!regions.empty() && regions.back().depth > state.size())
+        end_region();
       break;
     case Term::WRITE_SIGNED:
-      write_integer(state.top(), term.value.as_signed, output);
+      write_relative_integer
+        (state.top(), base, term.value.as_signed, *output);
       break;
     case Term::WRITE_UNSIGNED:
-      write_integer(state.top(), term.value.as_unsigned, output);
+      write_relative_integer
+        (state.top(), base, term.value.as_unsigned, *output);
       break;
     case Term::WRITE_DOUBLE:
-      write_float(state.top(), term.value.as_double, output);
+      write_float(state.top(), term.value.as_double, *output);
+      break;
+    case Term::WRITE_OCTETS:
+      output->write(term.value.as_octets.data,
+        term.value.as_octets.data + term.value.as_octets.size);
+      break;
+    case Term::INCLUDE:
+      self_contained = false;
+      output->include(term.value.as_include.path,
+        term.value.as_include.offset, term.value.as_include.size);
+      break;
+    case Term::RANDOM:
+      write_random(state.top(), base,
+        term.value.as_random.seed, term.value.as_random.count, *output);
+      break;
+    case Term::SEQUENCE:
+      write_sequences(state.top(), base, term.value.as_sequences.data,
+        term.value.as_sequences.size, *output);
       break;
+    case Term::CHECKSUM:
+    case Term::SECTION:
+    case Term::AT:
+      if (term.type != Term::CHECKSUM)
+        self_contained = false;
+      expecting_region = true;
+      next_region = term;
+      break;
+    // A position depends on everything written before, which
+    // a cached input's state doesn't include.
+    case Term::HERE:
+      {
+        const auto& stream = term.value.as_name
+          ? section(term.value.as_name) : *output;
+        self_contained = false;
+        write_relative_integer
+          (state.top(), base, stream.tell(), *output);
+      }
+      break;
+    case Term::SIZE_OF:
+      reference_size(term.value.as_name);
+      break;
+    case Term::HOLE:
+      if (holes)
+        next_hole = term.value.as_name;
+      break;
+    // The state is only unshared if it's actually changed.
     case Term::SET_ENDIANNESS:
-      state.top().endianness = term.value.as_endianness;
+      if (state.top().endianness != term.value.as_endianness)
+        state.change().endianness = term.value.as_endianness;
       break;
     case Term::SET_SIGNEDNESS:
-      state.top().signedness = term.value.as_signedness;
+      if (state.top().signedness != term.value.as_signedness)
+        state.change().signedness = term.value.as_signedness;
       break;
     case Term::SET_WIDTH:
-      state.top().width = term.value.as_width;
+      if (state.top().width != term.value.as_width)
+        state.change().width = term.value.as_width;
       break;
     case Term::SET_FORMAT:
-      state.top().format = term.value.as_format;
+      if (state.top().format != term.value.as_format)
+        state.change().format = term.value.as_format;
+      break;
+    // Setting a relative mode also starts over with no base,
+    // even within braces.
+    case Term::SET_REFERENCE:
+      if (state.top().reference != term.value.as_reference)
+        state.change().reference = term.value.as_reference;
+      if (term.value.as_reference != Term::ABSOLUTE)
+        base = Base();
+      break;
+    }
+  }
+}
+
+// Writes the sizes of sections that were referred to before
+// they were complete, then destroys the sections, flushing
+// their sinks in parallel.
+void Interpreter::finish() {
+  for (const auto& reference : references) {
+    const auto size = reference.section->size();
+    const auto& state = reference.state;
+    const bool is_signed = state.signedness == Term::SIGNED;
+    switch (state.width) {
+    case 8:
+      place_size<uint8_t>(size, is_signed, state.endianness,
+        reference.placeholder, *reference.stream);
+      break;
+    case 16:
+      place_size<uint16_t>(size, is_signed, state.endianness,
+        reference.placeholder, *reference.stream);
+      break;
+    case 32:
+      place_size<uint32_t>(size, is_signed, state.endianness,
+        reference.placeholder, *reference.stream);
+      break;
+    case 64:
+      place_size<uint64_t>(size, is_signed, state.endianness,
+        reference.placeholder, *reference.stream);
       break;
     }
   }
+  references.clear();
+  output = nullptr;
+  std::vector<std::thread> flushes;
+  for (auto& entry : sections) {
+    auto& section = entry.second;
+    section.stream.reset();
+    if (section.sink)
+      flushes.emplace_back([&section] { section.sink->flush(); });
+  }
+  for (auto& flush : flushes)
+    flush.join();
+  sections.clear();
+}
+
+uint64_t Interpreter::size(const std::string& name) const {
+  return sections.at(name).stream->size();
+}
+
+// Takes a snapshot, unless the interpreter is in a region or
+// only counting, in which case there is none to be taken.
+bool Interpreter::snapshot(Snapshot& result) const {
+  if (output->counting() || expecting_region || !regions.empty())
+    return false;
+  for (const auto& section : sections)
+    if (!section.second.stream->settled())
+      return false;
+  result.states = state.states();
+  result.base = base;
+  result.bits = output->partial();
+  return true;
+}
+
+// Records output to 'recorder', noting whether it depends on
+// anything but the snapshot at the start of the recording.
+void Interpreter::record(std::ostream* const recorder) {
+  output->record(recorder);
+  if (recorder)
+    self_contained = true;
+}
+
+// Replaces the effect of an input with one recorded before,
+// given the snapshot at its end and its recorded output.
+void Interpreter::replay(const Snapshot& snapshot, const char* const path,
+  const uint64_t size) {
+  output->splice(path, size, snapshot.bits);
+  state.clear();
+  for (const auto& top : snapshot.states)
+    state.push(top);
+  base = snapshot.base;
+}
+
+// Collects the holes in the main output, from now on, in
+// 'holes', rather than writing their default values.
+void Interpreter::collect_holes(std::vector<Hole>* const holes) {
+  this->holes = holes;
+}
+
+// The state at each depth, from the outermost.
+std::vector<Interpreter::State> Interpreter::Stack::states() const {
+  std::vector<State> result;
+  result.reserve(depth);
+  for (const auto& level : levels)
+    result.insert(result.end(), level.shared + 1, level.state);
+  return result;
+}
+
+void Interpreter::begin_region() {
+  expecting_region = false;
+  Region region = { state.size(), next_region, 0, output };
+  if (next_region.type == Term::SECTION) {
+    output = &section(next_region.value.as_name);
+    regions.push_back(region);
+    return;
+  }
+  const bool placement = next_region.type == Term::AT;
+  // Placed output could overwrite a hole.
+  if (placement && holes)
+    throw std::runtime_error("Placement regions can't be used in templates.");
+  if (!output->aligned())
+    throw std::runtime_error(placement
+      ? "Placement regions must begin on a byte boundary."
+      : "Checksum regions must begin on a byte boundary.");
+  if (placement) {
+    // Bytes in a checksum region must be contiguous, and held
+    // output must be written in order.
+    for (const auto& enclosing : regions)
+      if (enclosing.term.type == Term::CHECKSUM
+        && enclosing.stream == output)
+        throw std::runtime_error
+          ("Output position can't change within a checksum region.");
+    for (const auto& reference : references)
+      if (reference.stream == output)
+        throw std::runtime_error
+          ("Output position can't change while a section size is pending.");
+    region.position = output->seek(next_region.value.as_unsigned);
+  } else {
+    const auto checksum = next_region.value.as_region;
+    if (checksum.placement == Term::BEFORE)
+      region.position = output->reserve(Digest::size(checksum.checksum));
+    output->begin_checksum(checksum.checksum);
+  }
+  regions.push_back(region);
+}
+
+// The checksum is written in the endianness of the state
+// enclosing the region.
+void Interpreter::end_region() {
+  const auto region = regions.back();
+  if (region.term.type == Term::SECTION) {
+    regions.pop_back();
+    output = region.stream;
+    return;
+  }
+  const bool placement = region.term.type == Term::AT;
+  if (!output->aligned())
+    throw std::runtime_error(placement
+      ? "Placement regions must end on a byte boundary."
+      : "Checksum regions must end on a byte boundary.");
+  regions.pop_back();
+  if (placement) {
+    output->seek(region.position);
+    return;
+  }
+  const auto checksum = region.term.value.as_region;
+  const auto value = output->end_checksum();
+  const auto endianness = state.top().endianness;
+  if (Digest::size(checksum.checksum) == sizeof(uint64_t))
+    place_checksum(uint64_t(value), endianness, region.position,
+      checksum.placement, *output);
+  else
+    place_checksum(uint32_t(value), endianness, region.position,
+      checksum.placement, *output);
+}
+
+// Sections other than the main output must be named on the
+// command line.
+Stream& Interpreter::section(const char* const name) {
+  const auto found = sections.find(name);
+  if (found == sections.end())
+    throw std::runtime_error(join("No output for section '", name,
+      "'; use '-o ", name, "=PATH'."));
+  return *found->second.stream;
+}
+
+// Reserves space for the size of a section, which is only
+// known once all input has been read. Output following the
+// placeholder is held in memory until then.
+void Interpreter::reference_size(const char* const name) {
+  const auto& current = state.top();
+  const auto& referenced = section(name);
+  if (current.format != Term::INTEGER || (current.width != 8
+    && current.width != 16 && current.width != 32 && current.width != 64))
+    throw std::runtime_error("Section sizes must be written as 8-, 16-,"
+      " 32-, or 64-bit integers.");
+  if (!output->aligned())
+    throw std::runtime_error
+      ("Section sizes must be written on a byte boundary.");
+  // Held output would be written after the seek back from a
+  // placement region.
+  for (const auto& enclosing : regions)
+    if (enclosing.stream == output && enclosing.term.type != Term::SECTION)
+      throw std::runtime_error(enclosing.term.type == Term::AT
+        ? "Section sizes can't be written within a placement region."
+        : "Section sizes can't be written within a checksum region.");
+  self_contained = false;
+  const SizeReference reference
+    = { output, output->reserve(current.width / 8), current, &referenced };
+  references.push_back(reference);
+}
+
+// A hole is checked by writing its default value, and then
+// written as zero, so that generated code can fill it in by
+// setting bits. Only values of a fixed size, independent of
+// any other, can be filled in.
+void Interpreter::write_hole(const Term& term) {
+  const std::string name(next_hole);
+  next_hole = nullptr;
+  const auto& current = state.top();
+  if (output != sections[std::string()].stream.get())
+    throw std::runtime_error("Holes must be in the main output.");
+  for (const auto& enclosing : regions)
+    if (enclosing.term.type == Term::CHECKSUM && enclosing.stream == output)
+      throw std::runtime_error("Holes can't be within a checksum region.");
+  if (is_relative(current))
+    throw std::runtime_error("Holes must be written as absolute values.");
+  if (current.format != Term::INTEGER && (current.format != Term::FLOAT
+    || (current.width != 32 && current.width != 64)))
+    throw std::runtime_error
+      ("Holes must be written as integers, or 32- or 64-bit floats.");
+  for (const auto& hole : *holes)
+    if (hole.name == name)
+      throw std::runtime_error(join("Duplicate hole: '", name, "'."));
+  Stream counter;
+  switch (term.type) {
+  case Term::WRITE_SIGNED:
+    write_integer(current, term.value.as_signed, counter);
+    break;
+  case Term::WRITE_UNSIGNED:
+    write_integer(current, term.value.as_unsigned, counter);
+    break;
+  case Term::WRITE_DOUBLE:
+    write_float(current, term.value.as_double, counter);
+    break;
+  default:
+    IMPOSSIBLE("hole without default value");
+  }
+  const Hole hole
+    = { name, output->tell_bits(), current, term.type, term.value };
+  holes->push_back(hole);
+  write_integer(current, Term::Unsigned(0), *output);
+}
+
+namespace {
+
+template<class T>
+void place_checksum(const T value, const Term::Endianness endianness,
+  const size_t placeholder, const Term::Placement placement,
+  Stream& output) {
+  const auto bytes = endian_bytes(value, endianness);
+  if (placement == Term::BEFORE)
+    output.patch(placeholder, &bytes[0]);
+  else
+    output.write(&bytes[0], &bytes[0] + bytes.size());
+}
+
+template<class T>
+void place_size(const uint64_t size, const bool is_signed,
+  const Term::Endianness endianness, const size_t placeholder,
+  Stream& output) {
+  const uint64_t limit = std::numeric_limits<T>::max() >> is_signed;
+  if (size > limit)
+    throw std::runtime_error(join("Section size (", size,
+      ") exceeds range of ", is_signed ? "signed " : "unsigned ",
+      sizeof(T) * 8, "-bit integer."));
+  const auto bytes = endian_bytes(T(size), endianness);
+  output.patch(placeholder, &bytes[0]);
+}
+
 }
@@ -4,23 +4,153 @@
 #include <Term.h>
 
 #include <iosfwd>
-#include <stack>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 class Interpreter {
 public:
   Interpreter(std::ostream&);
+  Interpreter();
+  void add_section(const std::string&, std::ostream*);
   void run(const std::vector<Term>&);
+  void finish();
+  uint64_t size(const std::string& = std::string()) const;
+  // Packed into one word.
   struct State {
     State();
-    Term::Width width;
-    Term::Endianness endianness;
-    Term::Signedness signedness;
-    Term::Format format;
+    Term::Width width : 8;
+    Term::Endianness endianness : 2;
+    Term::Signedness signedness : 1;
+    Term::Format format : 3;
+    Term::Reference reference : 2;
   };
+  // The base of relative values, which is kept apart from the
+  // state, since braces leave no trace in the output: the last
+  // relative value written, in delta mode, or the first one, in
+  // frame of reference mode. 'reference' is the mode of the
+  // last relative value written, or 'ABSOLUTE' if there is none.
+  struct Base {
+    Base();
+    Term::Reference reference;
+    Term::Unsigned value;
+  };
+  const State& top() const { return state.top(); }
+  size_t depth() const { return state.size(); }
+  // The state of the interpreter between inputs, which is all
+  // that an input's output can depend on, unless it places
+  // values or includes files.
+  struct Snapshot {
+    std::vector<State> states;
+    Base base;
+    std::vector<uint8_t> bits;
+  };
+  bool snapshot(Snapshot&) const;
+  void record(std::ostream*);
+  bool replayable() const { return self_contained; }
+  void replay(const Snapshot&, const char*, uint64_t);
+  // A value in the main output to be filled in by code
+  // generated from a template, at a bit offset, written in
+  // 'state', with a default value of write term 'type'.
+  struct Hole {
+    std::string name;
+    uint64_t offset;
+    State state;
+    Term::Type type;
+    Term::Value value;
+  };
+  void collect_holes(std::vector<Hole>*);
 private:
-  Stream output;
-  std::stack<State> state;
+  // A checksum, placement, or section region opened at a
+  // given state depth, by 'term', in the section 'stream'. For
+  // checksums written before the region, 'position' is the
+  // placeholder; for placements, it is the output position at
+  // which to resume.
+  struct Region {
+    size_t depth;
+    Term term;
+    uint64_t position;
+    Stream* stream;
+  };
+  // Output written to 'sink', or only counted if it's null.
+  struct Section {
+    std::unique_ptr<Stream> stream;
+    std::ostream* sink;
+  };
+  // A placeholder for the final size of 'section', written
+  // in 'state' and patched by 'finish'.
+  struct SizeReference {
+    Stream* stream;
+    size_t placeholder;
+    State state;
+    const Stream* section;
+  };
+  // The state at each depth of braces, in which a level shares
+  // the state of the one outside it until the state is changed,
+  // so braces that don't change it only count their depth.
+  class Stack {
+  public:
+    Stack() : depth(0) {}
+    size_t size() const { return depth; }
+    const State& top() const { return levels.back().state; }
+    State& change() {
+      if (levels.back().shared) {
+        --levels.back().shared;
+        const Level level = { levels.back().state, 0 };
+        levels.push_back(level);
+      }
+      return levels.back().state;
+    }
+    void push() {
+      ++levels.back().shared;
+      ++depth;
+    }
+    void push(const State& state) {
+      const Level level = { state, 0 };
+      levels.push_back(level);
+      ++depth;
+    }
+    void pop() {
+      if (levels.back().shared)
+        --levels.back().shared;
+      else
+        levels.pop_back();
+      --depth;
+    }
+    void clear() {
+      levels.clear();
+      depth = 0;
+    }
+    std::vector<State> states() const;
+  private:
+    // A state and how many levels above it share it.
+    struct Level {
+      State state;
+      size_t shared;
+    };
+    std::vector<Level> levels;
+    size_t depth;
+  };
+  void begin_region();
+  void end_region();
+  Stream& section(const char*);
+  void reference_size(const char*);
+  void write_hole(const Term&);
+  // The unnamed section is the main output.
+  std::map<std::string, Section> sections;
+  Stream* output;
+  std::vector<SizeReference> references;
+  Stack state;
+  Base base;
+  std::vector<Region> regions;
+  bool expecting_region;
+  Term next_region;
+  bool self_contained;
+  // Holes are collected, and written as zero, only when
+  // 'holes' is set; otherwise their defaults are written.
+  std::vector<Hole>* holes;
+  const char* next_hole;
 };
 
 #endif
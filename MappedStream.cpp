@@ -0,0 +1,145 @@
+#include <MappedStream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// The file grows by at least 'minimum_growth' and at most
+// 'maximum_growth' bytes beyond what is needed, so that it is
+// remapped rarely but not preallocated far past the output.
+const uint64_t minimum_growth = 1 << 20;
+const uint64_t maximum_growth = 1 << 26;
+
+}
+
+// The file is truncated to the end of the output, which may
+// be before its initial end.
+MappedBuffer::MappedBuffer(const int file, const bool owned)
+  : file(file), owned(owned), base(nullptr), capacity(0), extent(0),
+    allocated(0), position(0) {
+  const auto start = lseek(file, 0, SEEK_CUR);
+  if (start != -1)
+    extent = position = start;
+}
+
+// Writes are made durable with 'msync' before the mapping is
+// released, and the file is trimmed to the bytes written.
+MappedBuffer::~MappedBuffer() {
+  mark();
+  if (base) {
+    msync(base, extent, MS_SYNC);
+    munmap(base, capacity);
+  }
+  if (ftruncate(file, extent) == 0)
+    lseek(file, extent, SEEK_SET);
+  if (owned)
+    close(file);
+}
+
+MappedBuffer::int_type MappedBuffer::overflow(const int_type character) {
+  if (!reserve(cursor() + 1))
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(character);
+    pbump(1);
+  }
+  return traits_type::not_eof(character);
+}
+
+std::streamsize MappedBuffer::xsputn
+  (const char* const data, const std::streamsize size) {
+  if (size > epptr() - pptr() && !reserve(cursor() + size))
+    return 0;
+  std::memcpy(pptr(), data, size);
+  // 'pbump' takes an 'int', which a large write may exceed.
+  for (auto rest = size; rest > 0; ) {
+    const auto step = std::min<std::streamsize>
+      (rest, std::numeric_limits<int>::max());
+    pbump(step);
+    rest -= step;
+  }
+  return size;
+}
+
+// Seeking past the end leaves a hole, which is not allocated,
+// even where it was preallocated ahead of the output.
+MappedBuffer::pos_type MappedBuffer::seekoff(const off_type distance,
+  const std::ios_base::seekdir direction, const std::ios_base::openmode) {
+  mark();
+  const off_type origin = direction == std::ios_base::beg ? 0
+    : direction == std::ios_base::cur ? cursor() : extent;
+  if (origin + distance < 0)
+    return pos_type(off_type(-1));
+  const auto end = std::min(uint64_t(origin + distance), allocated);
+  if (end > extent)
+    fallocate(file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, extent,
+      end - extent);
+  place(origin + distance);
+  return pos_type(origin + distance);
+}
+
+MappedBuffer::pos_type MappedBuffer::seekpos
+  (const pos_type position, const std::ios_base::openmode mode) {
+  return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
+int MappedBuffer::sync() {
+  mark();
+  return base && msync(base, extent, MS_SYNC) == -1 ? -1 : 0;
+}
+
+// Grows the file and the mapping to hold at least 'size'
+// bytes. Space is preallocated from the cursor, so that holes
+// left by seeking past what was allocated stay sparse.
+bool MappedBuffer::reserve(const uint64_t size) {
+  if (size <= capacity)
+    return true;
+  const auto start = cursor();
+  mark();
+  const auto page = uint64_t(sysconf(_SC_PAGESIZE));
+  auto grown = size + std::min(std::max(capacity, minimum_growth),
+    maximum_growth);
+  grown = (grown + page - 1) / page * page;
+  if (ftruncate(file, grown) == -1)
+    return false;
+  const auto from = std::max(start, allocated);
+  if (from < grown && fallocate(file, 0, from, grown - from) == 0)
+    allocated = grown;
+  const auto mapping = base
+    ? mremap(base, capacity, grown, MREMAP_MAYMOVE)
+    : mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  base = static_cast<char*>(mapping);
+  capacity = grown;
+  madvise(base, capacity, MADV_SEQUENTIAL);
+  place(start);
+  return true;
+}
+
+uint64_t MappedBuffer::cursor() const {
+  return pptr() ? pptr() - base : position;
+}
+
+// Moves the cursor, which may lie beyond the mapping until
+// something is written there.
+void MappedBuffer::place(const uint64_t target) {
+  if (base && target <= capacity) {
+    setp(base + target, base + capacity);
+  } else {
+    setp(nullptr, nullptr);
+    position = target;
+  }
+}
+
+// Records how far the output has been written.
+void MappedBuffer::mark() {
+  if (pptr() != pbase())
+    extent = std::max(extent, uint64_t(pptr() - base));
+}
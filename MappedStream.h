@@ -0,0 +1,49 @@
+#ifndef PROTODATA_MAPPEDSTREAM_H
+#define PROTODATA_MAPPEDSTREAM_H
+
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+
+// An output buffer that writes a regular file through a shared
+// mapping, growing the file ahead of the output and writing
+// values in place. Positions never written to are left as
+// holes.
+class MappedBuffer : public std::streambuf {
+public:
+  MappedBuffer(int, bool);
+  MappedBuffer(const MappedBuffer&) = delete;
+  MappedBuffer& operator=(const MappedBuffer&) = delete;
+  ~MappedBuffer();
+protected:
+  int_type overflow(int_type) override;
+  std::streamsize xsputn(const char*, std::streamsize) override;
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+    std::ios_base::openmode) override;
+  pos_type seekpos(pos_type, std::ios_base::openmode) override;
+  int sync() override;
+private:
+  bool reserve(uint64_t);
+  uint64_t cursor() const;
+  void place(uint64_t);
+  void mark();
+  const int file;
+  const bool owned;
+  char* base;
+  uint64_t capacity;
+  uint64_t extent;
+  uint64_t allocated;
+  uint64_t position;
+};
+
+class MappedStream : public std::ostream {
+public:
+  MappedStream(int descriptor, bool owned)
+    : std::ostream(nullptr), buffer(descriptor, owned) {
+    rdbuf(&buffer);
+  }
+private:
+  MappedBuffer buffer;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include <Optimizer.h>
+
+#include <Stats.h>
+#include <write.h>
+
+
+namespace {
+
+// Encoded bytes are written once there are this many, and
+// blobs up to this size are joined to them.
+const size_t encoded_limit = 1 << 16;
+const size_t joined_limit = 1 << 12;
+
+template<class T>
+void append(const T& value, const Term::Endianness endianness,
+  std::vector<uint8_t>& output) {
+  const auto bytes = endian_bytes(value, endianness);
+  output.insert(output.end(), bytes.begin(), bytes.end());
+}
+
+template<class T>
+bool encode_float(const Interpreter::State&, const T&,
+  std::vector<uint8_t>&);
+template<class T>
+bool encode_integer(const Interpreter::State&, const T&,
+  std::vector<uint8_t>&);
+
+}
+
+Optimizer::Optimizer(Interpreter& interpreter, const bool enabled)
+  : interpreter(interpreter), enabled(enabled), pushes(0),
+    current(interpreter.top()), passing(false) {}
+
+void Optimizer::run(const std::vector<Term>& terms) {
+  if (!enabled) {
+    interpreter.run(terms);
+    return;
+  }
+  STATS_PHASE(ENCODE);
+  for (const auto& term : terms) {
+    // The term opening a region must be followed directly by
+    // its '{', or the interpreter reports the error, and a hole
+    // by its default value, which mustn't be encoded ahead.
+    if (passing) {
+      passing = false;
+      flush(&term);
+      continue;
+    }
+    switch (term.type) {
+    case Term::NOOP:
+      break;
+    case Term::PUSH:
+      if (!sets.empty())
+        flush();
+      ++pushes;
+      // Braces the interpreter never sees count as well.
+      STATS(reach(interpreter.depth() + pushes));
+      break;
+    case Term::POP:
+      sets.clear();
+      if (pushes) {
+        --pushes;
+        current = interpreter.top();
+      } else {
+        flush(&term);
+      }
+      break;
+    case Term::WRITE_SIGNED:
+    case Term::WRITE_UNSIGNED:
+    case Term::WRITE_DOUBLE:
+      if (!encode(term))
+        flush(&term);
+      break;
+    case Term::WRITE_OCTETS:
+      if (term.value.as_octets.size <= joined_limit)
+        encoded.insert(encoded.end(), term.value.as_octets.data,
+          term.value.as_octets.data + term.value.as_octets.size);
+      else
+        flush(&term);
+      break;
+    case Term::CHECKSUM:
+    case Term::AT:
+    case Term::SECTION:
+    case Term::HOLE:
+      flush(&term);
+      passing = true;
+      break;
+    case Term::SET_ENDIANNESS:
+    case Term::SET_SIGNEDNESS:
+    case Term::SET_WIDTH:
+    case Term::SET_FORMAT:
+      set(term);
+      break;
+    // Setting a relative mode resets the base, so it can't be
+    // dropped or merged.
+    case Term::SET_REFERENCE:
+      if (term.value.as_reference == Term::ABSOLUTE)
+        set(term);
+      else
+        flush(&term);
+      break;
+    default:
+      flush(&term);
+      break;
+    }
+  }
+  if (encoded.size() >= encoded_limit)
+    flush();
+}
+
+// Runs everything held back, followed by 'next', if any.
+// Encoded bytes don't depend on the state, so they can go
+// first.
+void Optimizer::flush(const Term* const next) {
+  if (!enabled) {
+    if (next)
+      interpreter.run(std::vector<Term>(1, *next));
+    return;
+  }
+  // Everything is taken before it's run, so nothing is run
+  // twice if it fails.
+  forwarded.clear();
+  flushing.swap(encoded);
+  encoded.clear();
+  if (!flushing.empty())
+    forwarded.push_back(Term::write(&flushing[0], flushing.size()));
+  forwarded.insert(forwarded.end(), pushes, Term::push());
+  forwarded.insert(forwarded.end(), sets.begin(), sets.end());
+  if (next)
+    forwarded.push_back(*next);
+  pushes = 0;
+  sets.clear();
+  if (!forwarded.empty())
+    interpreter.run(forwarded);
+  current = interpreter.top();
+}
+
+// A later change to the same part of the state overrides an
+// earlier one. An explicit endianness that is the platform's
+// is the same as 'native'.
+void Optimizer::set(const Term& term) {
+  Term changed(term);
+  if (term.type == Term::SET_ENDIANNESS
+    && term.value.as_endianness == platform_endianness())
+    changed.value.as_endianness = Term::NATIVE;
+  auto previous = sets.begin();
+  while (previous != sets.end() && previous->type != term.type)
+    ++previous;
+  if (previous == sets.end())
+    sets.push_back(changed);
+  else
+    *previous = changed;
+  switch (term.type) {
+  case Term::SET_ENDIANNESS:
+    current.endianness = changed.value.as_endianness;
+    break;
+  case Term::SET_SIGNEDNESS:
+    current.signedness = term.value.as_signedness;
+    break;
+  case Term::SET_WIDTH:
+    current.width = term.value.as_width;
+    break;
+  case Term::SET_FORMAT:
+    current.format = term.value.as_format;
+    break;
+  default:
+    current.reference = term.value.as_reference;
+    break;
+  }
+}
+
+// Encodes a value in the state it will have when written, if
+// its bytes don't depend on anything else.
+bool Optimizer::encode(const Term& term) {
+  const auto& state = current;
+  if (is_relative(state))
+    return false;
+  bool written;
+  switch (term.type) {
+  case Term::WRITE_SIGNED:
+    written = encode_integer(state, term.value.as_signed, encoded);
+    break;
+  case Term::WRITE_UNSIGNED:
+    written = encode_integer(state, term.value.as_unsigned, encoded);
+    break;
+  default:
+    written = encode_float(state, term.value.as_double, encoded);
+    break;
+  }
+  if (written)
+    STATS(values[state.format][state.width]++);
+  return written;
+}
+
+namespace {
+
+// Encodes values as 'write_integer' and 'write_float' do,
+// in the formats whose bytes can be appended directly.
+template<class T>
+bool encode_float(const Interpreter::State& state, const T& input,
+  std::vector<uint8_t>& output) {
+  const auto endianness = state.endianness;
+  switch (state.format) {
+  case Term::FLOAT:
+    switch (state.width) {
+    case 16:
+      append(half_from_double(input), endianness, output);
+      return true;
+    case 32:
+      append(float(input), endianness, output);
+      return true;
+    case 64:
+      append(double(input), endianness, output);
+      return true;
+    default:
+      return false;
+    }
+  case Term::BFLOAT:
+    append(bfloat_from_double(input), endianness, output);
+    return true;
+  default:
+    return false;
+  }
+}
+
+template<class T>
+bool encode_integer(const Interpreter::State& state, const T& input,
+  std::vector<uint8_t>& output) {
+  const auto endianness = state.endianness;
+  if (state.format != Term::INTEGER)
+    return encode_float(state, input, output);
+  const bool is_signed = state.signedness == Term::SIGNED;
+  switch (state.width) {
+  case 8:
+    if (is_signed)
+      append(checked_integer<int8_t>(input), endianness, output);
+    else
+      append(checked_integer<uint8_t>(input), endianness, output);
+    return true;
+  case 16:
+    if (is_signed)
+      append(checked_integer<int16_t>(input), endianness, output);
+    else
+      append(checked_integer<uint16_t>(input), endianness, output);
+    return true;
+  case 32:
+    if (is_signed)
+      append(checked_integer<int32_t>(input), endianness, output);
+    else
+      append(checked_integer<uint32_t>(input), endianness, output);
+    return true;
+  case 64:
+    if (is_signed)
+      append(checked_integer<int64_t>(input), endianness, output);
+    else
+      append(checked_integer<uint64_t>(input), endianness, output);
+    return true;
+  default:
+    return false;
+  }
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef PROTODATA_OPTIMIZER_H
+#define PROTODATA_OPTIMIZER_H
+
+#include <Interpreter.h>
+#include <Term.h>
+
+#include <cstdint>
+#include <vector>
+
+// A peephole pass between the parser and the interpreter.
+// State changes are held back until something depends on
+// them, so those overridden, or undone by '}', are dropped,
+// as are braces around nothing but values. Absolute values of
+// whole bytes are encoded as they arrive, and runs of them are
+// written as one term of raw bytes.
+class Optimizer {
+public:
+  Optimizer(Interpreter&, bool);
+  Optimizer(const Optimizer&) = delete;
+  Optimizer& operator=(const Optimizer&) = delete;
+  void run(const std::vector<Term>&);
+  void flush(const Term* = nullptr);
+private:
+  void set(const Term&);
+  bool encode(const Term&);
+  Interpreter& interpreter;
+  const bool enabled;
+  // Set terms for different parts of the state, which apply
+  // within any pending braces.
+  std::vector<Term> sets;
+  size_t pushes;
+  // The state with the held changes made.
+  Interpreter::State current;
+  std::vector<uint8_t> encoded;
+  std::vector<uint8_t> flushing;
+  // Whether the next term is to be run as it is.
+  bool passing;
+  std::vector<Term> forwarded;
+};
+
+#endif
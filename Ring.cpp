@@ -0,0 +1,139 @@
+#include <Ring.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int setup(const unsigned entries, io_uring_params& parameters) {
+  return syscall(__NR_io_uring_setup, entries, &parameters);
+}
+
+int enter(const int ring, const unsigned submitted, const unsigned awaited,
+  const unsigned flags) {
+  return syscall(__NR_io_uring_enter, ring, submitted, awaited, flags,
+    nullptr, 0);
+}
+
+int register_buffers(const int ring, const std::vector<iovec>& buffers) {
+  return syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS,
+    &buffers[0], buffers.size());
+}
+
+template<class T>
+T* at(void* const base, const uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}
+
+// The submission queue has one entry per buffer, since each
+// buffer is written by at most one request at a time.
+Ring::Ring(const int file, const std::vector<iovec>& buffers)
+  : file(file), ring(-1), registered(false),
+    submissions(MAP_FAILED), submissions_size(0),
+    completions(MAP_FAILED), completions_size(0),
+    entries(nullptr), entries_size(0) {
+  io_uring_params parameters;
+  std::memset(&parameters, 0, sizeof(parameters));
+  ring = setup(buffers.size(), parameters);
+  if (ring == -1)
+    throw std::runtime_error(join("Unable to set up io_uring: ",
+      std::strerror(errno), "."));
+  submissions_size = parameters.sq_off.array
+    + parameters.sq_entries * sizeof(unsigned);
+  completions_size = parameters.cq_off.cqes
+    + parameters.cq_entries * sizeof(io_uring_cqe);
+  const bool single = parameters.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    submissions_size = completions_size
+      = std::max(submissions_size, completions_size);
+  submissions = mmap(nullptr, submissions_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+  completions = single ? submissions : mmap(nullptr, completions_size,
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+    IORING_OFF_CQ_RING);
+  entries_size = parameters.sq_entries * sizeof(io_uring_sqe);
+  const auto mapped_entries = mmap(nullptr, entries_size,
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+    IORING_OFF_SQES);
+  if (mapped_entries != MAP_FAILED)
+    entries = static_cast<io_uring_sqe*>(mapped_entries);
+  if (submissions == MAP_FAILED || completions == MAP_FAILED || !entries) {
+    release();
+    throw std::runtime_error("Unable to map io_uring.");
+  }
+  sq_tail = at<unsigned>(submissions, parameters.sq_off.tail);
+  sq_mask = at<unsigned>(submissions, parameters.sq_off.ring_mask);
+  sq_array = at<unsigned>(submissions, parameters.sq_off.array);
+  cq_head = at<unsigned>(completions, parameters.cq_off.head);
+  cq_tail = at<unsigned>(completions, parameters.cq_off.tail);
+  cq_mask = at<unsigned>(completions, parameters.cq_off.ring_mask);
+  cqes = at<io_uring_cqe>(completions, parameters.cq_off.cqes);
+  // Registration pins the buffers, and may exceed the locked
+  // memory limit; unregistered writes are merely slower.
+  registered = register_buffers(ring, buffers) == 0;
+}
+
+Ring::~Ring() {
+  release();
+}
+
+void Ring::release() {
+  if (entries)
+    munmap(entries, entries_size);
+  if (completions != MAP_FAILED && completions != submissions)
+    munmap(completions, completions_size);
+  if (submissions != MAP_FAILED)
+    munmap(submissions, submissions_size);
+  if (ring != -1)
+    close(ring);
+}
+
+// Submits a write of 'size' bytes from 'data', which must lie
+// within the given registered buffer, at 'offset' in the file.
+void Ring::write(const unsigned buffer, const char* const data,
+  const size_t size, const uint64_t offset) {
+  const auto tail = *sq_tail;
+  const auto index = tail & *sq_mask;
+  auto& entry = entries[index];
+  std::memset(&entry, 0, sizeof(entry));
+  entry.opcode = registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  entry.fd = file;
+  entry.off = offset;
+  entry.addr = reinterpret_cast<uint64_t>(data);
+  entry.len = size;
+  entry.buf_index = registered ? buffer : 0;
+  entry.user_data = buffer;
+  sq_array[index] = index;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  while (enter(ring, 1, 0, 0) == -1) {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      throw std::runtime_error(join("Unable to submit write: ",
+        std::strerror(errno), "."));
+  }
+}
+
+Ring::Completion Ring::wait() {
+  while (true) {
+    const auto head = *cq_head;
+    if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      const auto& entry = cqes[head & *cq_mask];
+      const Completion completion = { unsigned(entry.user_data), entry.res };
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      return completion;
+    }
+    if (enter(ring, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR)
+      throw std::runtime_error(join("Unable to await write: ",
+        std::strerror(errno), "."));
+  }
+}
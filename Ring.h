@@ -0,0 +1,50 @@
+#ifndef PROTODATA_RING_H
+#define PROTODATA_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// A minimal io_uring for writing whole buffers to a file at
+// given offsets. Throws if io_uring is unavailable, so that
+// the caller can fall back to synchronous writes.
+class Ring {
+public:
+  // The outcome of one write: its buffer and the number of
+  // bytes written, or a negated 'errno'.
+  struct Completion {
+    unsigned buffer;
+    int result;
+  };
+  Ring(int, const std::vector<iovec>&);
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+  ~Ring();
+  void write(unsigned, const char*, size_t, uint64_t);
+  Completion wait();
+private:
+  void release();
+  const int file;
+  int ring;
+  bool registered;
+  void* submissions;
+  size_t submissions_size;
+  void* completions;
+  size_t completions_size;
+  io_uring_sqe* entries;
+  size_t entries_size;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  io_uring_cqe* cqes;
+};
+
+#endif
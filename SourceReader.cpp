@@ -0,0 +1,337 @@
+#include <SourceReader.h>
+
+#include <Stats.h>
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <tmmintrin.h>
+#endif
+
+namespace {
+
+// Input is read in blocks of at most this many bytes.
+const size_t block_size = 1 << 20;
+
+const uint8_t byte_order_mark[] = { 0xef, 0xbb, 0xbf };
+
+size_t first_invalid(const uint8_t*, size_t);
+void transcode(const uint8_t*, const uint8_t*, std::vector<uint32_t>&);
+
+}
+
+SourceReader::SourceReader(std::istream& input)
+  : input(input), offset(0), position(0), lines(0), started(false),
+    failed(false), invalid(0) {}
+
+// Sets the range to the next line, including its newline if
+// it has one, or to an empty range at the end of the input.
+// A line with invalid UTF-8 is cut short at the first invalid
+// sequence, which is reported by returning false.
+bool SourceReader::next(Runes& begin, Runes& end) {
+  if (position == runes.size() && !failed)
+    fill();
+  begin = runes.begin() + position;
+  const auto newline = std::find(begin, runes.cend(), U'\n');
+  end = newline == runes.cend() ? newline : newline + 1;
+  position = end - runes.cbegin();
+  if (begin != end || failed)
+    ++lines;
+  return newline != runes.cend() || !failed;
+}
+
+// Reads until there is at least one whole line, or the end of
+// the input, and transcodes every whole line read, as far as
+// the first invalid sequence, if any.
+void SourceReader::fill() {
+  runes.clear();
+  position = 0;
+  size_t cut;
+  while (true) {
+    const auto start = bytes.size();
+    if (!receive()) {
+      cut = bytes.size();
+      break;
+    }
+    auto last = bytes.end();
+    while (last != bytes.begin() + start && last[-1] != '\n')
+      --last;
+    if (last != bytes.begin() + start) {
+      cut = last - bytes.begin();
+      break;
+    }
+  }
+  if (!cut)
+    return;
+  size_t skipped = 0;
+  if (!started && cut >= sizeof byte_order_mark
+    && std::equal(std::begin(byte_order_mark), std::end(byte_order_mark),
+      bytes.begin()))
+    skipped = sizeof byte_order_mark;
+  started = true;
+  const auto data = bytes.data() + skipped;
+  const auto size = cut - skipped;
+  const auto valid = validate_utf8(data, size);
+  transcode(data, data + valid, runes);
+  if (valid != size) {
+    failed = true;
+    invalid = offset + skipped + valid;
+  }
+  STATS(bytes_read += cut);
+  STATS(runes += runes.size());
+  bytes.erase(bytes.begin(), bytes.begin() + cut);
+  offset += cut;
+}
+
+// Appends whatever input is buffered, or else waits for the
+// next line, so that input from a pipe is compiled as soon as
+// each line is written. Returns false at the end of the input.
+bool SourceReader::receive() {
+  STATS_PHASE(READ);
+  auto& source = *input.rdbuf();
+  const auto available = source.in_avail();
+  if (available > 0) {
+    const auto size = bytes.size();
+    bytes.resize(size + std::min<size_t>(available, block_size));
+    bytes.resize(size + source.sgetn
+      (reinterpret_cast<char*>(&bytes[size]), bytes.size() - size));
+    return true;
+  }
+  if (!std::getline(input, buffer)) {
+    if (!input.eof())
+      throw std::runtime_error("Unable to read input.");
+    return false;
+  }
+  bytes.insert(bytes.end(), buffer.begin(), buffer.end());
+  if (!input.eof())
+    bytes.push_back('\n');
+  return true;
+}
+
+namespace {
+
+#if defined(__x86_64__)
+
+// Kinds of error in a pair of bytes, which are found from the
+// nibbles of the pair by table lookups, after Keiser and
+// Lemire, "Validating UTF-8 In Less Than One Instruction Per
+// Byte". Any lead byte followed by too few continuations is
+// 'too_short', and a continuation with no lead byte is either
+// 'too_long' or 'two_continuations', except where a third or
+// fourth byte is expected.
+const uint8_t too_short = 1 << 0;
+const uint8_t too_long = 1 << 1;
+const uint8_t overlong_3 = 1 << 2;
+const uint8_t too_large = 1 << 3;
+const uint8_t surrogate = 1 << 4;
+const uint8_t overlong_2 = 1 << 5;
+const uint8_t too_large_1000 = 1 << 6;
+const uint8_t overlong_4 = 1 << 6;
+const uint8_t two_continuations = 1 << 7;
+const uint8_t carry = too_short | too_long | two_continuations;
+
+// By the high nibble of the first byte.
+const uint8_t first_high[16] = {
+  too_long, too_long, too_long, too_long,
+  too_long, too_long, too_long, too_long,
+  two_continuations, two_continuations, two_continuations, two_continuations,
+  too_short | overlong_2,
+  too_short,
+  too_short | overlong_3 | surrogate,
+  too_short | too_large | too_large_1000 | overlong_4,
+};
+
+// By the low nibble of the first byte.
+const uint8_t first_low[16] = {
+  carry | overlong_3 | overlong_2 | overlong_4,
+  carry | overlong_2,
+  carry,
+  carry,
+  carry | too_large,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000 | surrogate,
+  carry | too_large | too_large_1000,
+  carry | too_large | too_large_1000,
+};
+
+// By the high nibble of the second byte.
+const uint8_t second_high[16] = {
+  too_short, too_short, too_short, too_short,
+  too_short, too_short, too_short, too_short,
+  too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000
+    | overlong_4,
+  too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+  too_long | overlong_2 | two_continuations | surrogate | too_large,
+  too_long | overlong_2 | two_continuations | surrogate | too_large,
+  too_short, too_short, too_short, too_short,
+};
+
+// The last three bytes of a block can't begin sequences longer
+// than what's left of it.
+const uint8_t last_complete[16] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf,
+};
+
+__attribute__((target("ssse3")))
+__m128i lookup(const uint8_t (&table)[16], const __m128i nibbles) {
+  return _mm_shuffle_epi8
+    (_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)), nibbles);
+}
+
+// Errors in each byte of a block, given the block before it.
+__attribute__((target("ssse3")))
+__m128i block_errors(const __m128i block, const __m128i previous) {
+  const auto nibble = _mm_set1_epi8(0x0f);
+  const auto first = _mm_alignr_epi8(block, previous, 15);
+  const auto errors = _mm_and_si128(_mm_and_si128(
+    lookup(first_high, _mm_and_si128(_mm_srli_epi16(first, 4), nibble)),
+    lookup(first_low, _mm_and_si128(first, nibble))),
+    lookup(second_high, _mm_and_si128(_mm_srli_epi16(block, 4), nibble)));
+  // Continuations two or three bytes after a lead byte of a
+  // longer sequence are expected.
+  const auto third = _mm_subs_epu8
+    (_mm_alignr_epi8(block, previous, 14), _mm_set1_epi8(0xe0 - 0x80));
+  const auto fourth = _mm_subs_epu8
+    (_mm_alignr_epi8(block, previous, 13), _mm_set1_epi8(0xf0 - 0x80));
+  const auto expected = _mm_and_si128
+    (_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+  return _mm_xor_si128(expected, errors);
+}
+
+// Runs of ASCII are skipped a block at a time. A final
+// partial block is padded with zeros, which end any sequence
+// left incomplete.
+__attribute__((target("ssse3")))
+bool valid_ssse3(const uint8_t* const data, const size_t size) {
+  const auto zero = _mm_setzero_si128();
+  const auto complete
+    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(last_complete));
+  auto errors = zero, previous = zero, incomplete = zero;
+  for (size_t i = 0; i < size; i += 16) {
+    __m128i block;
+    if (size - i >= 16) {
+      block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    } else {
+      uint8_t tail[16] = {};
+      std::memcpy(tail, data + i, size - i);
+      block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+    }
+    if (_mm_movemask_epi8(block) == 0) {
+      errors = _mm_or_si128(errors, incomplete);
+      incomplete = zero;
+    } else {
+      errors = _mm_or_si128(errors, block_errors(block, previous));
+      incomplete = _mm_subs_epu8(block, complete);
+    }
+    previous = block;
+  }
+  errors = _mm_or_si128(errors, incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, zero)) == 0xffff;
+}
+
+const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+
+#endif
+
+// Finds the first invalid sequence one at a time, skipping
+// runs of ASCII a word at a time. Overlong forms, surrogates,
+// and code points beyond U+10FFFF are invalid.
+size_t first_invalid(const uint8_t* const data, const size_t size) {
+  size_t i = 0;
+  while (i < size) {
+    if (size - i >= 8) {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof word);
+      if (!(word & 0x8080808080808080ull)) {
+        i += 8;
+        continue;
+      }
+    }
+    const uint8_t lead = data[i];
+    if (lead < 0x80) {
+      ++i;
+      continue;
+    }
+    size_t length;
+    uint8_t low = 0x80, high = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+      length = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+      length = 3;
+      if (lead == 0xe0)
+        low = 0xa0;
+      else if (lead == 0xed)
+        high = 0x9f;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+      length = 4;
+      if (lead == 0xf0)
+        low = 0x90;
+      else if (lead == 0xf4)
+        high = 0x8f;
+    } else {
+      return i;
+    }
+    if (size - i < length || data[i + 1] < low || data[i + 1] > high)
+      return i;
+    for (size_t k = 2; k < length; ++k)
+      if ((data[i + k] & 0xc0) != 0x80)
+        return i;
+    i += length;
+  }
+  return size;
+}
+
+// Decodes UTF-8 that is known to be valid.
+void transcode(const uint8_t* here, const uint8_t* const end,
+  std::vector<uint32_t>& runes) {
+  if (here == end)
+    return;
+  const auto start = runes.size();
+  runes.resize(start + (end - here));
+  auto output = &runes[start];
+  while (here != end) {
+    const uint32_t lead = *here;
+    if (lead < 0x80) {
+      *output++ = lead;
+      ++here;
+    } else if (lead < 0xe0) {
+      *output++ = (lead & 0x1f) << 6 | (here[1] & 0x3f);
+      here += 2;
+    } else if (lead < 0xf0) {
+      *output++ = (lead & 0x0f) << 12 | (here[1] & 0x3f) << 6
+        | (here[2] & 0x3f);
+      here += 3;
+    } else {
+      *output++ = (lead & 0x07) << 18 | (here[1] & 0x3f) << 12
+        | (here[2] & 0x3f) << 6 | (here[3] & 0x3f);
+      here += 4;
+    }
+  }
+  runes.resize(output - &runes[0]);
+}
+
+}
+
+// The offset of the first byte that doesn't begin a valid
+// UTF-8 sequence, or 'size' if there is none. Input that is
+// all valid, as source almost always is, is checked sixteen
+// bytes at a time where the processor allows it, and only
+// otherwise searched sequence by sequence.
+size_t validate_utf8(const uint8_t* const data, const size_t size) {
+#if defined(__x86_64__)
+  if (has_ssse3 && valid_ssse3(data, size))
+    return size;
+#endif
+  return first_invalid(data, size);
+}
@@ -0,0 +1,47 @@
+#ifndef PROTODATA_SOURCEREADER_H
+#define PROTODATA_SOURCEREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Reads source as runes, a line at a time. Input is read in
+// blocks of as much as is available, and all the whole lines
+// in a block are validated as UTF-8 and transcoded at once,
+// so the lexer never checks a rune itself. A byte order mark
+// at the start of the input is skipped.
+class SourceReader {
+public:
+  typedef std::vector<uint32_t>::const_iterator Runes;
+  SourceReader(std::istream&);
+  SourceReader(const SourceReader&) = delete;
+  SourceReader& operator=(const SourceReader&) = delete;
+  bool next(Runes&, Runes&);
+  unsigned int line() const { return lines; }
+  uint64_t invalid_offset() const { return invalid; }
+private:
+  void fill();
+  bool receive();
+  std::istream& input;
+  // Bytes read but not yet transcoded, from 'offset' in the
+  // input, which end with an incomplete line.
+  std::vector<uint8_t> bytes;
+  uint64_t offset;
+  std::string buffer;
+  // Runes of whole lines, of which those from 'position' are
+  // yet to be read.
+  std::vector<uint32_t> runes;
+  size_t position;
+  unsigned int lines;
+  bool started;
+  // Whether the runes end at invalid UTF-8, which begins at
+  // byte 'invalid' of the input.
+  bool failed;
+  uint64_t invalid;
+};
+
+size_t validate_utf8(const uint8_t*, size_t);
+
+#endif
@@ -0,0 +1,104 @@
+#include <SpillStream.h>
+
+#include <Stream.h>
+#include <util.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+SpillBuffer::SpillBuffer(const size_t limit)
+  : storage(limit), file(-1), spilled(0), failed(false) {
+  setp(&storage[0], &storage[0] + storage.size());
+}
+
+SpillBuffer::~SpillBuffer() {
+  if (file == -1)
+    return;
+  close(file);
+  std::remove(path.c_str());
+}
+
+// Copies everything written so far to 'output', directly from
+// memory if nothing was spilled.
+void SpillBuffer::copy_to(Stream& output) {
+  if (failed || (file != -1 && !spill()))
+    throw std::runtime_error(join("Unable to write temporary file: '",
+      path, "'."));
+  if (file == -1) {
+    const auto data = reinterpret_cast<const uint8_t*>(pbase());
+    output.write(data, data + (pptr() - pbase()));
+    return;
+  }
+  output.include(path.c_str(), 0, spilled);
+}
+
+SpillBuffer::int_type SpillBuffer::overflow(const int_type character) {
+  if (!spill())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(character);
+    pbump(1);
+  }
+  return traits_type::not_eof(character);
+}
+
+// Writes larger than the buffer go straight to the file.
+std::streamsize SpillBuffer::xsputn
+  (const char* const data, const std::streamsize size) {
+  if (size <= epptr() - pptr()) {
+    std::memcpy(pptr(), data, size);
+    pbump(size);
+    return size;
+  }
+  if (!spill())
+    return 0;
+  if (size < epptr() - pptr()) {
+    std::memcpy(pptr(), data, size);
+    pbump(size);
+    return size;
+  }
+  if (!write_all(data, size))
+    return 0;
+  spilled += size;
+  return size;
+}
+
+// Moves the buffered bytes to the file, creating it first in
+// TMPDIR, or '/tmp' if that isn't set.
+bool SpillBuffer::spill() {
+  if (file == -1) {
+    const char* const directory = std::getenv("TMPDIR");
+    path = join(directory && *directory ? directory : "/tmp",
+      "/pd-spill-XXXXXX");
+    file = mkstemp(&path[0]);
+    if (file == -1) {
+      failed = true;
+      return false;
+    }
+  }
+  const size_t size = pptr() - pbase();
+  const bool success = write_all(pbase(), size);
+  spilled += size;
+  setp(&storage[0], &storage[0] + storage.size());
+  return success;
+}
+
+bool SpillBuffer::write_all(const char* data, size_t size) {
+  while (size > 0) {
+    const auto result = ::write(file, data, size);
+    if (result == -1) {
+      if (errno == EINTR)
+        continue;
+      failed = true;
+      return false;
+    }
+    data += result;
+    size -= result;
+  }
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PROTODATA_SPILLSTREAM_H
+#define PROTODATA_SPILLSTREAM_H
+
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+class Stream;
+
+// An output buffer that holds up to a limit in memory, then
+// spills to a temporary file, so that many can be filled at
+// once in bounded memory and copied out in turn. The file is
+// removed with the buffer.
+class SpillBuffer : public std::streambuf {
+public:
+  explicit SpillBuffer(size_t);
+  SpillBuffer(const SpillBuffer&) = delete;
+  SpillBuffer& operator=(const SpillBuffer&) = delete;
+  ~SpillBuffer();
+  uint64_t size() const { return spilled + (pptr() - pbase()); }
+  void copy_to(Stream&);
+protected:
+  int_type overflow(int_type) override;
+  std::streamsize xsputn(const char*, std::streamsize) override;
+private:
+  bool spill();
+  bool write_all(const char*, size_t);
+  std::vector<char> storage;
+  std::string path;
+  int file;
+  uint64_t spilled;
+  bool failed;
+};
+
+class SpillStream : public std::ostream {
+public:
+  explicit SpillStream(size_t limit)
+    : std::ostream(nullptr), buffer(limit) {
+    rdbuf(&buffer);
+  }
+  uint64_t size() const { return buffer.size(); }
+  void copy_to(Stream& output) { buffer.copy_to(output); }
+private:
+  SpillBuffer buffer;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include <Stats.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+Stats* stats = nullptr;
+
+namespace {
+
+const char* const token_names[] = {
+  "brace", "command", "comment", "function", "type", "integer", "float",
+  "string", "blob",
+};
+
+const char* const phase_names[] = {
+  "other", "read", "lex", "literal", "encode", "write",
+};
+
+const char* const term_names[] = {
+  "noop", "push", "pop", "write_signed", "write_unsigned", "write_double",
+  "write_octets", "include", "checksum", "at", "random", "sequence",
+  "section", "here", "size_of", "hole",
+  "set_endianness", "set_signedness", "set_width", "set_format",
+  "set_reference",
+};
+
+const char* const format_names[] = {
+  "integer", "float", "bfloat", "unicode", "uleb128", "sleb128", "zigzag",
+  "prefix_varint",
+};
+
+static_assert(sizeof(term_names) / sizeof(*term_names) == Stats::term_types,
+  "Every term type must have a name.");
+
+struct Counter {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+// Task time is a software counter, available even where the
+// hardware counters are not, as in most virtual machines.
+const Counter available_counters[] = {
+  { "task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+  { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+int open_counter(const Counter& counter, const int group) {
+  perf_event_attr attributes;
+  std::memset(&attributes, 0, sizeof(attributes));
+  attributes.size = sizeof(attributes);
+  attributes.type = counter.type;
+  attributes.config = counter.config;
+  attributes.read_format = PERF_FORMAT_GROUP;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attributes, 0, -1, group, 0);
+}
+
+double seconds(const std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+double seconds(const timeval& time) {
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+
+typedef std::vector<std::pair<std::string, uint64_t>> Counts;
+
+// The nonzero counts, with their names.
+template<size_t N>
+Counts nonzero(const char* const (&names)[N], const uint64_t* const counts) {
+  Counts result;
+  for (size_t i = 0; i < N; ++i)
+    if (counts[i] != 0)
+      result.push_back(std::make_pair(names[i], counts[i]));
+  return result;
+}
+
+// Writes counts as "name": count in JSON and as name count
+// otherwise.
+void write_counts(std::ostream& output, const bool json,
+  const Counts& counts) {
+  for (size_t i = 0; i < counts.size(); ++i) {
+    output << (i == 0 ? "" : ", ");
+    if (json)
+      output << '"' << counts[i].first << "\": " << counts[i].second;
+    else
+      output << counts[i].first << ' ' << counts[i].second;
+  }
+}
+
+// Often enough for a useful breakdown of short runs, but
+// rarely enough that sampling costs little.
+const long sample_microseconds = 1000;
+
+void on_profile(int) {
+  if (stats)
+    stats->sample();
+}
+
+}
+
+Stats::Stats(const bool hardware)
+  : bytes_read(0), runes(0), bytes(0), bits(0), max_depth(1),
+    phase(OTHER), start(Clock::now()), sampling(false), group(-1) {
+  tokens.fill(0);
+  terms.fill(0);
+  for (auto& widths : values)
+    widths.fill(0);
+  samples.fill(0);
+  if (hardware) {
+    for (const auto& counter : available_counters) {
+      const auto file = open_counter(counter, group);
+      if (file == -1)
+        continue;
+      if (group == -1)
+        group = file;
+      files.push_back(file);
+      counter_names.push_back(counter.name);
+    }
+    counter_values.resize(counter_names.size());
+    buffer.resize(counter_names.size() + 1);
+    counters.resize(counter_names.size());
+    for (auto& phases : counters)
+      phases.fill(0);
+    if (group != -1) {
+      const auto size = buffer.size() * sizeof(uint64_t);
+      if (read(group, &buffer[0], size) == ssize_t(size))
+        std::copy(buffer.begin() + 1, buffer.end(), counter_values.begin());
+    }
+  }
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = on_profile;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  const itimerval timer = {
+    { 0, sample_microseconds }, { 0, sample_microseconds },
+  };
+  sampling = sigaction(SIGPROF, &action, nullptr) == 0
+    && setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+}
+
+Stats::~Stats() {
+  stop();
+  for (const auto file : files)
+    close(file);
+}
+
+// Charges a sample, and the counters since the last one, to
+// the current phase. This runs in a signal handler, so it
+// mustn't allocate.
+void Stats::sample() {
+  const auto current = Phase(phase);
+  ++samples[current];
+  if (group == -1)
+    return;
+  const auto size = buffer.size() * sizeof(uint64_t);
+  if (read(group, &buffer[0], size) != ssize_t(size))
+    return;
+  for (size_t i = 0; i < counter_values.size(); ++i) {
+    counters[i][current] += buffer[i + 1] - counter_values[i];
+    counter_values[i] = buffer[i + 1];
+  }
+}
+
+void Stats::stop() {
+  if (!sampling)
+    return;
+  const itimerval timer = { { 0, 0 }, { 0, 0 } };
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  signal(SIGPROF, SIG_DFL);
+  sampling = false;
+}
+
+void Stats::report(std::ostream& output, const bool json) {
+  // The counters since the last sample count too.
+  stop();
+  if (group != -1)
+    sample();
+  const auto total = Clock::now() - start;
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const double cpu = seconds(usage.ru_utime) + seconds(usage.ru_stime);
+  uint64_t sampled = 0;
+  for (const auto count : samples)
+    sampled += count;
+  // CPU time in each phase, in proportion to its samples.
+  const auto phase_seconds = [&](const size_t i) {
+    return sampled ? cpu * samples[i] / sampled : 0.0;
+  };
+  Counts value_counts;
+  for (size_t format = 0; format < formats; ++format)
+    for (size_t width = 0; width < values[format].size(); ++width)
+      if (values[format][width] != 0)
+        value_counts.push_back(std::make_pair(std::string
+          (format_names[format]) + std::to_string(width),
+          values[format][width]));
+  if (json) {
+    output << "{\n  \"bytes_read\": " << bytes_read
+      << ",\n  \"runes\": " << runes
+      << ",\n  \"tokens\": {";
+    write_counts(output, json, nonzero(token_names, &tokens[0]));
+    output << "},\n  \"terms\": {";
+    write_counts(output, json, nonzero(term_names, &terms[0]));
+    output << "},\n  \"values\": {";
+    write_counts(output, json, value_counts);
+    output << "},\n  \"bytes_written\": " << bytes
+      << ",\n  \"unaligned_bits\": " << bits
+      << ",\n  \"max_depth\": " << max_depth
+      << ",\n  \"wall_seconds\": " << seconds(total)
+      << ",\n  \"cpu_seconds\": {\"user\": " << seconds(usage.ru_utime)
+      << ", \"system\": " << seconds(usage.ru_stime) << "}"
+      << ",\n  \"samples\": " << sampled
+      << ",\n  \"phase_cpu_seconds\": {";
+    for (size_t i = 0; i < PHASES; ++i)
+      output << (i == 0 ? "" : ", ") << '"' << phase_names[i] << "\": "
+        << phase_seconds(i);
+    output << "}";
+    for (size_t i = 0; i < counters.size(); ++i) {
+      output << ",\n  \"" << counter_names[i] << "\": {";
+      write_counts(output, json, nonzero(phase_names, &counters[i][0]));
+      output << "}";
+    }
+    output << "\n}\n";
+    return;
+  }
+  output << "Read: " << bytes_read << " bytes, " << runes << " runes\n"
+    << "Tokens: ";
+  write_counts(output, json, nonzero(token_names, &tokens[0]));
+  output << "\nTerms: ";
+  write_counts(output, json, nonzero(term_names, &terms[0]));
+  output << "\nValues: ";
+  write_counts(output, json, value_counts);
+  output << "\nWritten: " << bytes << " bytes, " << bits
+    << " unaligned bits\n"
+    << "Maximum state depth: " << max_depth << '\n'
+    << "Wall time: " << seconds(total) << "s\n"
+    << "CPU time: user " << seconds(usage.ru_utime) << "s, system "
+    << seconds(usage.ru_stime) << "s\n"
+    << "CPU time by phase, from " << sampled << " samples:";
+  for (size_t i = 0; i < PHASES; ++i)
+    output << (i == 0 ? " " : ", ") << phase_names[i] << ' '
+      << phase_seconds(i) << 's';
+  output << '\n';
+  for (size_t i = 0; i < counters.size(); ++i) {
+    output << counter_names[i] << ": ";
+    write_counts(output, json, nonzero(phase_names, &counters[i][0]));
+    output << '\n';
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef PROTODATA_STATS_H
+#define PROTODATA_STATS_H
+
+#include <Term.h>
+
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// Counts and timings of the work done by a compilation, which
+// are gathered only when 'pd' is run with '--stats'. Building
+// with PROTODATA_NO_STATS removes the instrumentation. The
+// time spent in each phase is sampled with a profiling timer,
+// since phases change as often as every byte written.
+class Stats {
+public:
+  enum Token {
+    BRACE,
+    COMMAND,
+    COMMENT,
+    FUNCTION,
+    TYPE,
+    INTEGER,
+    FLOAT,
+    STRING,
+    BLOB,
+    TOKEN_KINDS,
+  };
+  enum Phase {
+    OTHER,
+    READ,
+    LEX,
+    LITERAL,
+    ENCODE,
+    WRITE,
+    PHASES,
+  };
+  static const size_t term_types = Term::SET_REFERENCE + 1;
+  static const size_t formats = Term::PREFIX_VARINT + 1;
+  explicit Stats(bool);
+  Stats(const Stats&) = delete;
+  Stats& operator=(const Stats&) = delete;
+  ~Stats();
+  // Changing phase only notes the new one, so that it costs
+  // next to nothing; time and counters are sampled.
+  Phase enter(const Phase next) {
+    const auto previous = Phase(phase);
+    phase = next;
+    return previous;
+  }
+  void reach(const size_t depth) {
+    if (depth > max_depth)
+      max_depth = depth;
+  }
+  void sample();
+  void report(std::ostream&, bool);
+  uint64_t bytes_read;
+  uint64_t runes;
+  std::array<uint64_t, TOKEN_KINDS> tokens;
+  std::array<uint64_t, term_types> terms;
+  std::array<std::array<uint64_t, 65>, formats> values;
+  uint64_t bytes;
+  uint64_t bits;
+  size_t max_depth;
+private:
+  typedef std::chrono::steady_clock Clock;
+  void stop();
+  volatile sig_atomic_t phase;
+  Clock::time_point start;
+  bool sampling;
+  std::array<uint64_t, PHASES> samples;
+  // Hardware counters, if requested and available, read as a
+  // group at every sample into 'buffer', which is allocated
+  // up front, since samples are taken in a signal handler.
+  int group;
+  std::vector<int> files;
+  std::vector<const char*> counter_names;
+  std::vector<uint64_t> counter_values;
+  std::vector<uint64_t> buffer;
+  std::vector<std::array<uint64_t, PHASES>> counters;
+};
+
+// The statistics being gathered, if any.
+extern Stats* stats;
+
+// Charges the time spent in a scope to a phase.
+class PhaseScope {
+public:
+  explicit PhaseScope(const Stats::Phase phase)
+    : previous(stats ? stats->enter(phase) : Stats::OTHER) {}
+  PhaseScope(const PhaseScope&) = delete;
+  PhaseScope& operator=(const PhaseScope&) = delete;
+  ~PhaseScope() {
+    if (stats)
+      stats->enter(previous);
+  }
+private:
+  const Stats::Phase previous;
+};
+
+#ifdef PROTODATA_NO_STATS
+#define STATS(ACTION) static_cast<void>(0)
+#define STATS_PHASE(PHASE) static_cast<void>(0)
+#else
+#define STATS(ACTION) do { if (::stats) ::stats->ACTION; } while (false)
+#define STATS_PHASE(PHASE) const PhaseScope phase_scope(Stats::PHASE)
+#endif
+
+#endif
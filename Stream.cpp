@@ -1,20 +1,65 @@
 #include <Stream.h>
 
+#include <FileStream.h>
+#include <Stats.h>
+#include <util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
 #include <ostream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct file_closer {
+  const int file;
+  ~file_closer() { close(file); }
+};
+
+}
+
+// Errors writing the rest of the output can't be thrown from
+// here; an output that can fail keeps them to report itself.
 Stream::~Stream() {
-  const auto extra = buffer.size() % 8;
-  if (extra != 0)
-    for (int i = 0; i < (8 - extra); ++i)
-      buffer.push_back(false);
-  flush();
+  if (counting())
+    return;
+  try {
+    const auto extra = buffer.size() % 8;
+    if (extra != 0)
+      for (int i = 0; i < (8 - extra); ++i)
+        buffer.push_back(false);
+    flush();
+    if (!held.empty())
+      put(&held[0], held.size());
+  } catch (...) {}
+}
+
+// Byte-aligned runs bypass the bit buffer entirely.
+void Stream::write(const uint8_t* const begin, const uint8_t* const end) {
+  if (counting())
+    count(uint64_t(end - begin) * 8);
+  else if (buffer.empty())
+    emit(begin, end - begin);
+  else
+    for (auto octet = begin; octet != end; ++octet)
+      write(char(*octet));
 }
 
 void Stream::write(const char raw) {
+  if (counting()) {
+    count(8);
+    return;
+  }
   const uint8_t octet = raw;
   if (buffer.empty()) {
-    stream.put(octet);
+    emit(&octet, 1);
   } else {
+    STATS(bits += 8);
     for (int i = 7; i >= 0; --i)
       buffer.push_back(bool(octet & (1 << i)));
   }
@@ -22,22 +67,251 @@ void Stream::write(const char raw) {
 }
 
 void Stream::write(const uint64_t data, const int bits) {
+  if (counting()) {
+    count(bits);
+    return;
+  }
+  STATS(bits += bits);
   for (int i = bits - 1; i >= 0; --i)
-    buffer.push_back(bool(data & (1 << i)));
+    buffer.push_back(bool(data & (uint64_t(1) << i)));
   flush();
 }
 
 void Stream::write_bit(const bool bit) {
+  if (counting()) {
+    count(1);
+    return;
+  }
+  STATS(bits++);
   buffer.push_back(bit);
   flush();
 }
 
+// Copies 'size' bytes of a file starting at 'offset', or the
+// rest of the file if 'size' is the maximum value. When the
+// output is byte-aligned and backed by a file descriptor, the
+// kernel copies the data directly; otherwise it is mapped
+// and written in bulk, or read in blocks if it can't be.
+void Stream::include
+  (const char* const path, const uint64_t offset, uint64_t size) {
+  const auto file = open(path, O_RDONLY);
+  if (file == -1)
+    throw std::runtime_error(join("Unable to open file: '", path, "'."));
+  const file_closer closer = { file };
+  struct stat status;
+  if (fstat(file, &status) == -1)
+    throw std::runtime_error(join("Unable to read file: '", path, "'."));
+  if (!S_ISREG(status.st_mode)) {
+    include_blocks(path, file, offset, size);
+    return;
+  }
+  const uint64_t file_size = status.st_size;
+  if (offset > file_size)
+    throw std::runtime_error(join("Offset (", offset, ") exceeds size of '",
+      path, "' (", file_size, " bytes)."));
+  if (size == std::numeric_limits<uint64_t>::max())
+    size = file_size - offset;
+  else if (size > file_size - offset)
+    throw std::runtime_error(join("Range (", offset, " + ", size,
+      ") exceeds size of '", path, "' (", file_size, " bytes)."));
+  if (counting()) {
+    count(size * 8);
+    return;
+  }
+  STATS_PHASE(WRITE);
+  uint64_t copied = 0;
+  if (buffer.empty() && digests.empty() && placeholders.empty()) {
+    if (const auto file_buffer = dynamic_cast<FileBuffer*>(stream->rdbuf()))
+      copied = file_buffer->copy_from(file, offset, size);
+    position += copied;
+    STATS(bytes += copied);
+  }
+  if (copied == size)
+    return;
+  const uint64_t start = offset + copied,
+    page = sysconf(_SC_PAGESIZE),
+    aligned = start / page * page,
+    length = offset + size - aligned;
+  const auto mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE,
+    file, aligned);
+  if (mapping == MAP_FAILED) {
+    if (lseek(file, start, SEEK_SET) == -1)
+      throw std::runtime_error(join("Unable to read file: '", path, "'."));
+    include_blocks(path, file, 0, size - copied);
+    return;
+  }
+  madvise(mapping, length, MADV_SEQUENTIAL);
+  const auto begin = static_cast<const uint8_t*>(mapping) + (start - aligned);
+  write(begin, begin + (size - copied));
+  munmap(mapping, length);
+}
+
+// Fallback for files that cannot be mapped, such as pipes:
+// reads from the current position, skipping 'offset' bytes.
+void Stream::include_blocks(const char* const path, const int file,
+  uint64_t offset, uint64_t size) {
+  const bool bounded = size != std::numeric_limits<uint64_t>::max();
+  std::vector<uint8_t> block(1 << 16);
+  while (size > 0) {
+    const auto result = read(file, &block[0],
+      std::min<uint64_t>(offset + size, block.size()));
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      throw std::runtime_error(join("Unable to read file: '", path, "'."));
+    if (result == 0)
+      break;
+    const uint64_t skipped = std::min<uint64_t>(offset, result);
+    offset -= skipped;
+    const uint64_t written
+      = std::min<uint64_t>(size, result - skipped);
+    const uint8_t* const data = &block[skipped];
+    write(data, data + written);
+    size -= written;
+  }
+  if (bounded && (offset != 0 || size != 0))
+    throw std::runtime_error(join("Range exceeds size of '", path, "'."));
+}
+
 void Stream::flush() {
   while (buffer.size() >= 8) {
     uint8_t octet = 0;
     for (int i = 0; i < 8; ++i)
       octet |= *(buffer.begin() + i) << (7 - i);
     buffer.erase(buffer.begin(), buffer.begin() + 8);
-    stream.put(octet);
+    emit(&octet, 1);
   }
 }
+
+// Moves the output to an absolute position, returning the
+// previous one. The size is the furthest the output has reached
+// at any position.
+uint64_t Stream::seek(const uint64_t offset) {
+  const auto previous = position;
+  extent = size();
+  if (!counting() && !stream->seekp(offset))
+    throw std::runtime_error("Output is not seekable.");
+  position = offset;
+  return previous;
+}
+
+// Counts bits as though they were written, without encoding
+// or writing anything.
+void Stream::count(const uint64_t bits) {
+  position += (pending + bits) / 8;
+  pending = (pending + bits) % 8;
+}
+
+// The size in bytes of the output so far, including a final
+// partial byte, which would be padded with zeros.
+uint64_t Stream::size() const {
+  return std::max(extent, position + (pending + buffer.size() + 7) / 8);
+}
+
+// Copies all bytes written from here on to 'recorder' as
+// well, until recording stops with a null pointer. Bytes
+// copied from files by 'include' may bypass it.
+void Stream::record(std::ostream* const recorder) {
+  this->recorder = recorder;
+}
+
+// Writes 'size' bytes recorded from a file in place of what
+// the recording began with, leaving 'partial' bits pending.
+void Stream::splice(const char* const path, const uint64_t size,
+  const std::vector<uint8_t>& partial) {
+  buffer.clear();
+  include(path, 0, size);
+  buffer = partial;
+}
+
+// Checksums are not computed when counting, since their
+// values don't affect the size of the output.
+void Stream::begin_checksum(const Term::Checksum algorithm) {
+  if (counting())
+    return;
+  const Running running = { Digest(algorithm), position, position };
+  digests.push_back(running);
+}
+
+uint64_t Stream::end_checksum() {
+  if (counting())
+    return 0;
+  feed();
+  if (digests.back().fed != position)
+    IMPOSSIBLE("checksum region contains an unpatched placeholder");
+  const auto value = digests.back().digest.value();
+  digests.pop_back();
+  return value;
+}
+
+// Writes 'size' zero bytes to be patched later, and holds all
+// output from here on in memory until every placeholder has
+// been patched. Returns a handle to the placeholder.
+size_t Stream::reserve(const size_t size) {
+  if (counting()) {
+    count(size * 8);
+    return 0;
+  }
+  if (placeholders.empty())
+    held_start = position;
+  const Placeholder placeholder = { position, size, false };
+  placeholders.push_back(placeholder);
+  const std::vector<uint8_t> zeros(size);
+  emit(&zeros[0], size);
+  return placeholders.size() - 1;
+}
+
+void Stream::patch(const size_t handle, const uint8_t* const data) {
+  if (counting())
+    return;
+  auto& placeholder = placeholders[handle];
+  std::copy(data, data + placeholder.size,
+    &held[placeholder.offset - held_start]);
+  placeholder.patched = true;
+  feed();
+  for (const auto& placeholder : placeholders)
+    if (!placeholder.patched)
+      return;
+  put(&held[0], held.size());
+  held.clear();
+  placeholders.clear();
+}
+
+// All complete bytes go through here on their way out.
+void Stream::emit(const uint8_t* const data, const size_t size) {
+  STATS_PHASE(WRITE);
+  STATS(bytes += size);
+  position += size;
+  if (placeholders.empty()) {
+    for (auto& running : digests) {
+      running.digest.update(data, size);
+      running.fed = position;
+    }
+    put(data, size);
+  } else {
+    held.insert(held.end(), data, data + size);
+    feed();
+  }
+}
+
+// Feeds held bytes to each digest, stopping at the first
+// placeholder in its region that has yet to be patched.
+void Stream::feed() {
+  for (auto& running : digests) {
+    uint64_t limit = position;
+    for (const auto& placeholder : placeholders)
+      if (!placeholder.patched && placeholder.offset >= running.start)
+        limit = std::min(limit, placeholder.offset);
+    if (running.fed < limit) {
+      running.digest.update(&held[running.fed - held_start],
+        limit - running.fed);
+      running.fed = limit;
+    }
+  }
+}
+
+void Stream::put(const uint8_t* const data, const size_t size) {
+  stream->write(reinterpret_cast<const char*>(data), size);
+  if (recorder)
+    recorder->write(reinterpret_cast<const char*>(data), size);
+}
@@ -1,13 +1,21 @@
 #ifndef PROTODATA_STREAM_H
 #define PROTODATA_STREAM_H
 
+#include <Digest.h>
+#include <Term.h>
+
 #include <cstdint>
 #include <iosfwd>
 #include <vector>
 
 class Stream {
 public:
-  Stream(std::ostream& stream) : stream(stream) {}
+  Stream(std::ostream& stream)
+    : stream(&stream), recorder(nullptr), position(0), pending(0),
+      extent(0) {}
+  Stream()
+    : stream(nullptr), recorder(nullptr), position(0), pending(0),
+      extent(0) {}
   Stream(const Stream&) = delete;
   Stream(Stream&&) = delete;
   Stream& operator=(const Stream&) = delete;
@@ -18,13 +26,54 @@ public:
     while (begin != end)
       write(*begin++);
   }
+  void write(const uint8_t*, const uint8_t*);
   void write_bit(bool);
   void write(char);
   void write(uint64_t, int);
+  void include(const char*, uint64_t, uint64_t);
+  bool aligned() const { return buffer.empty() && pending == 0; }
+  bool counting() const { return !stream; }
+  void count(uint64_t);
+  uint64_t size() const;
+  uint64_t seek(uint64_t);
+  uint64_t tell() const { return position; }
+  uint64_t tell_bits() const { return position * 8 + pending + buffer.size(); }
+  bool settled() const { return digests.empty() && placeholders.empty(); }
+  const std::vector<uint8_t>& partial() const { return buffer; }
+  void record(std::ostream*);
+  void splice(const char*, uint64_t, const std::vector<uint8_t>&);
+  void begin_checksum(Term::Checksum);
+  uint64_t end_checksum();
+  size_t reserve(size_t);
+  void patch(size_t, const uint8_t*);
 private:
+  // A digest of the bytes from 'start', fed up to 'fed'.
+  struct Running {
+    Digest digest;
+    uint64_t start;
+    uint64_t fed;
+  };
+  // Reserved bytes at 'offset', waiting to be patched.
+  struct Placeholder {
+    uint64_t offset;
+    size_t size;
+    bool patched;
+  };
+  void include_blocks(const char*, int, uint64_t, uint64_t);
+  void emit(const uint8_t*, size_t);
+  void put(const uint8_t*, size_t);
+  void feed();
   void flush();
-  std::ostream& stream;
+  std::ostream* const stream;
+  std::ostream* recorder;
   std::vector<uint8_t> buffer;
+  uint64_t position;
+  uint64_t pending;
+  uint64_t extent;
+  std::vector<Running> digests;
+  std::vector<Placeholder> placeholders;
+  std::vector<uint8_t> held;
+  uint64_t held_start;
 };
 
 #endif
@@ -20,6 +20,10 @@ Term::Term(const Format format) : type(SET_FORMAT) {
   value.as_format = format;
 }
 
+Term::Term(const Reference reference) : type(SET_REFERENCE) {
+  value.as_reference = reference;
+}
+
 Term::Term(const Type type, const void* const source = 0) : type(type) {
   switch (type) {
   case NOOP:
@@ -31,11 +35,33 @@ Term::Term(const Type type, const void* const source = 0) : type(type) {
     value.as_signed = *static_cast<const Signed*>(source);
     break;
   case WRITE_UNSIGNED:
+  case AT:
     value.as_unsigned = *static_cast<const Unsigned*>(source);
     break;
   case WRITE_DOUBLE:
     value.as_double = *static_cast<const Double*>(source);
     break;
+  case WRITE_OCTETS:
+    value.as_octets = *static_cast<const Octets*>(source);
+    break;
+  case INCLUDE:
+    value.as_include = *static_cast<const Include*>(source);
+    break;
+  case CHECKSUM:
+    value.as_region = *static_cast<const Region*>(source);
+    break;
+  case RANDOM:
+    value.as_random = *static_cast<const Random*>(source);
+    break;
+  case SEQUENCE:
+    value.as_sequences = *static_cast<const Sequences*>(source);
+    break;
+  case SECTION:
+  case HERE:
+  case SIZE_OF:
+  case HOLE:
+    value.as_name = static_cast<const char*>(source);
+    break;
   default:
     IMPOSSIBLE("invalid Term type");
   }
@@ -60,3 +86,55 @@ Term Term::write(const int64_t value) {
 Term Term::write(const double value) {
   return Term(WRITE_DOUBLE, static_cast<const void*>(&value));
 }
+
+// The octets are not copied, and must outlive the term.
+Term Term::write(const uint8_t* const data, const size_t size) {
+  const Octets octets = { data, size };
+  return Term(WRITE_OCTETS, static_cast<const void*>(&octets));
+}
+
+// The path is not copied, and must outlive the term.
+Term Term::include
+  (const char* const path, const Unsigned offset, const Unsigned size) {
+  const Include include = { path, offset, size };
+  return Term(INCLUDE, static_cast<const void*>(&include));
+}
+
+Term Term::checksum(const Checksum checksum, const Placement placement) {
+  const Region region = { checksum, placement };
+  return Term(CHECKSUM, static_cast<const void*>(&region));
+}
+
+Term Term::at(const Unsigned offset) {
+  return Term(AT, static_cast<const void*>(&offset));
+}
+
+Term Term::random(const Unsigned seed, const Unsigned count) {
+  const Random random = { seed, count };
+  return Term(RANDOM, static_cast<const void*>(&random));
+}
+
+// The sequences are not copied, and must outlive the term.
+Term Term::sequence(const Sequence* const data, const size_t size) {
+  const Sequences sequences = { data, size };
+  return Term(SEQUENCE, static_cast<const void*>(&sequences));
+}
+
+// Names are not copied, and must outlive the term. 'here'
+// refers to the current section if the name is null.
+Term Term::section(const char* const name) {
+  return Term(SECTION, static_cast<const void*>(name));
+}
+
+Term Term::here(const char* const name) {
+  return Term(HERE, static_cast<const void*>(name));
+}
+
+Term Term::size_of(const char* const name) {
+  return Term(SIZE_OF, static_cast<const void*>(name));
+}
+
+// A hole is followed by the write term of its default value.
+Term Term::hole(const char* const name) {
+  return Term(HOLE, static_cast<const void*>(name));
+}
@@ -1,6 +1,7 @@
 #ifndef PROTODATA_TOKEN_H
 #define PROTODATA_TOKEN_H
 
+#include <cstddef>
 #include <cstdint>
 
 class Term {
@@ -10,6 +11,11 @@ public:
     LITTLE,
     BIG,
   };
+  enum Reference {
+    ABSOLUTE,
+    DELTA,
+    FRAME,
+  };
   enum Signedness {
     UNSIGNED,
     SIGNED,
@@ -17,7 +23,23 @@ public:
   enum Format {
     INTEGER,
     FLOAT,
+    BFLOAT,
     UNICODE,
+    ULEB128,
+    SLEB128,
+    ZIGZAG,
+    PREFIX_VARINT,
+  };
+  enum Checksum {
+    CRC32,
+    CRC32C,
+    ADLER32,
+    XXH32,
+    XXH64,
+  };
+  enum Placement {
+    AFTER,
+    BEFORE,
   };
   enum Type {
     NOOP,
@@ -26,33 +48,93 @@ public:
     WRITE_SIGNED,
     WRITE_UNSIGNED,
     WRITE_DOUBLE,
+    WRITE_OCTETS,
+    INCLUDE,
+    CHECKSUM,
+    AT,
+    RANDOM,
+    SEQUENCE,
+    SECTION,
+    HERE,
+    SIZE_OF,
+    HOLE,
     SET_ENDIANNESS,
     SET_SIGNEDNESS,
     SET_WIDTH,
     SET_FORMAT,
+    SET_REFERENCE,
   };
   typedef int64_t Signed;
   typedef uint64_t Unsigned;
   typedef double Double;
   typedef unsigned int Width;
+  struct Octets {
+    const uint8_t* data;
+    size_t size;
+  };
+  struct Include {
+    const char* path;
+    Unsigned offset;
+    Unsigned size;
+  };
+  struct Region {
+    Checksum checksum;
+    Placement placement;
+  };
+  struct Random {
+    Unsigned seed;
+    Unsigned count;
+  };
+  struct Sequence;
+  struct Sequences {
+    const Sequence* data;
+    size_t size;
+  };
   Term();
   Term(Endianness);
   Term(Signedness);
   Term(Width);
   Term(Format);
+  Term(Reference);
   static Term push();
   static Term pop();
   static Term write(uint64_t);
   static Term write(int64_t);
   static Term write(double);
+  static Term write(const uint8_t*, size_t);
+  static Term include(const char*, Unsigned, Unsigned);
+  static Term checksum(Checksum, Placement);
+  static Term at(Unsigned);
+  static Term random(Unsigned, Unsigned);
+  static Term sequence(const Sequence*, size_t);
+  static Term section(const char*);
+  static Term here(const char*);
+  static Term size_of(const char*);
+  static Term hole(const char*);
   union Value {
     Signed as_signed;
     Unsigned as_unsigned;
     Double as_double;
+    Octets as_octets;
+    Include as_include;
+    Region as_region;
+    Random as_random;
+    Sequences as_sequences;
+    const char* as_name;
     Endianness as_endianness;
     Signedness as_signedness;
     Width as_width;
     Format as_format;
+    Reference as_reference;
+  };
+  // 'count' values from 'start' by 'step', where 'type' is
+  // the kind of write: signed or unsigned integers, which
+  // wrap modulo 2^64, or doubles.
+  struct Sequence {
+    Type type;
+    Value start;
+    Value step;
+    Unsigned count;
   };
   Type type;
   Value value;
@@ -1,13 +1,25 @@
 #include <arguments.h>
 
+#include <ComparingStream.h>
+#include <CompressedStream.h>
+#include <DecompressedStream.h>
+#include <FileStream.h>
+#include <MappedStream.h>
 #include <util.h>
 
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 struct print_usage : std::runtime_error {
   print_usage() : runtime_error("pd - The Protodata Compiler\n"
     "\n"
@@ -16,6 +28,17 @@ struct print_usage : std::runtime_error {
     "    pd  (IN)*\n"
     "        ((-e|--eval) STRING)*\n"
     "        ((-o|--output) OUT)?\n"
+    "        ((-o|--output) NAME=OUT)*\n"
+    "        (--io-uring | --direct | --mmap)?\n"
+    "        (--compress(=(lz4|zstd))?)?\n"
+    "        (--write-if-changed)?\n"
+    "        (--check | --size | --verify FILE | --decode TYPE |\n"
+    "          --emit-cpp NAME)?\n"
+    "        (--stats(=json)? | --stats-counters)?\n"
+    "        (--cache DIR)?\n"
+    "        (--no-opt)?\n"
+    "        (--columns LAYOUT (--delimiter CHAR)?\n"
+    "          (--align | --transpose(=N)? (--transpose-memory BYTES)?)?)?\n"
     "        (-- (IN)*)?\n"
     "\n"
     "'pd' takes zero or more Protodata source files (IN), zero or\n"
@@ -28,6 +51,60 @@ struct print_usage : std::runtime_error {
     "To read from standard input explicitly, use a hyphen ('-')\n"
     "in place of a file path. To read from files whose names may\n"
     "begin with dashes, precede them with a double dash ('--').\n"
+    "Source files compressed with gzip, or zstd in builds that\n"
+    "support it, are decompressed as they are read.\n"
+    "\n"
+    "'-o NAME=OUT' writes the output of 'section(\"NAME\") { ... }'\n"
+    "regions to OUT instead. Sections are written concurrently.\n"
+    "\n"
+    "'--io-uring' writes a regular output file asynchronously,\n"
+    "overlapping compilation with output, and '--direct' also\n"
+    "bypasses the page cache. Both fall back to ordinary writes\n"
+    "where they are unsupported. '--mmap' writes a regular\n"
+    "output file through a shared mapping instead.\n"
+    "\n"
+    "'--compress' compresses all output as an LZ4 frame, or zstd\n"
+    "with '--compress=zstd' in builds that support it. Outputs\n"
+    "whose paths end in '.lz4' or '.zst' are always compressed.\n"
+    "\n"
+    "'--check' only checks that the input is valid, and '--size'\n"
+    "prints the size in bytes of its output; neither writes any\n"
+    "output. '--verify FILE' checks that the output is identical\n"
+    "to FILE, stopping at the first difference, and writes none.\n"
+    "\n"
+    "'--write-if-changed' compares output with the existing files\n"
+    "as it is written, and replaces a file only if it differs.\n"
+    "\n"
+    "'--decode TYPE' reads binary input as values of TYPE, such\n"
+    "as 'big f32', and writes source that compiles back to it.\n"
+    "\n"
+    "'--emit-cpp NAME' compiles the input as a template, and\n"
+    "writes a C++ header declaring namespace NAME, in which\n"
+    "'encode' writes the same output with the values of any\n"
+    "'hole(\"name\", default)' in the template filled in.\n"
+    "\n"
+    "'--cache DIR' saves the output of each input in DIR, and\n"
+    "reuses it when the same input is compiled again in the same\n"
+    "state, so that only changed inputs are recompiled.\n"
+    "\n"
+    "'--no-opt' runs source as parsed, without first removing\n"
+    "redundant state changes and joining runs of values; the\n"
+    "output is the same either way.\n"
+    "\n"
+    "'--columns LAYOUT' reads input as rows of plain numbers,\n"
+    "rather than source, and writes them as records of the column\n"
+    "types in LAYOUT, such as 'u16 f32 f32'. Fields are separated\n"
+    "by whitespace, or by CHAR with '--delimiter', such as ',' for\n"
+    "CSV or '\\t' for TSV, in which case each line is a record.\n"
+    "'--align' pads columns and records as a C struct would be.\n"
+    "'--transpose' writes each column contiguously instead, each\n"
+    "starting at a multiple of N bytes with '--transpose=N'.\n"
+    "Columns are buffered in 64 MiB of memory in total, or BYTES\n"
+    "with '--transpose-memory', and spill to temporary files.\n"
+    "\n"
+    "'--stats' reports statistics and timings on standard error,\n"
+    "as JSON with '--stats=json'. '--stats-counters' also reports\n"
+    "hardware counters for each phase, where available.\n"
     "\n"
     "'pd' reads lazily and writes eagerly. It returns 0 if all\n"
     "input was consumed, or 1 if there was an error; the cause of\n"
@@ -44,11 +121,78 @@ struct excessive_value : std::runtime_error {
     : runtime_error(join("Too many values for option: '", option, "'.")) {}
 };
 
+struct unopenable_output : std::runtime_error {
+  unopenable_output(const std::string& path)
+    : runtime_error(join("Unable to open output file: '", path, "'.")) {}
+};
+
+struct uncreatable_cache : std::runtime_error {
+  uncreatable_cache(const std::string& path)
+    : runtime_error(join("Unable to create cache directory: '", path,
+      "'.")) {}
+};
+
+struct invalid_delimiter : std::runtime_error {
+  invalid_delimiter(const std::string& delimiter)
+    : runtime_error(join("Invalid delimiter: '", delimiter,
+      "'; it must be one character that can't begin a number.")) {}
+};
+
+struct invalid_value : std::runtime_error {
+  invalid_value(const std::string& option)
+    : runtime_error(join("Invalid value for option: '", option, "'.")) {}
+};
+
+struct conflicting_options : std::runtime_error {
+  conflicting_options(const std::string& a, const std::string& b)
+    : runtime_error(join("Options '", a, "' and '", b,
+      "' can't be used together.")) {}
+};
+
+struct dependent_option : std::runtime_error {
+  dependent_option(const std::string& option, const std::string& required)
+    : runtime_error(join("Option '", option, "' requires '", required,
+      "'.")) {}
+};
+
+struct unavailable_option : std::runtime_error {
+  unavailable_option(const std::string& option)
+    : runtime_error(join("Option not available in this build: '",
+      option, "'.")) {}
+};
+
+struct unsupported_input : std::runtime_error {
+  unsupported_input(const std::string& path, const std::string& format)
+    : runtime_error(join("Input compressed with ", format,
+      ", which is not supported in this build: '", path, "'.")) {}
+};
+
 struct unknown_option : std::runtime_error {
   unknown_option(const std::string& option)
     : runtime_error(join("Unknown option: '", option, "'.")) {}
 };
 
+// How to treat an existing output file: replace it, only
+// compare output with it, or replace it only if they differ.
+enum Overwrite {
+  ALWAYS_OVERWRITE,
+  NEVER_OVERWRITE,
+  OVERWRITE_IF_CHANGED,
+};
+
+// How to compress an output, if at all.
+enum Compression {
+  NO_COMPRESSION,
+  LZ4_COMPRESSION,
+  ZSTD_COMPRESSION,
+};
+
+Input open_input(const char*, bool);
+std::string section_name(const char*);
+unique_ostream open_output(const char*, bool, bool, bool, Compression,
+  Overwrite, std::vector<std::shared_ptr<ComparingBuffer>>&);
+unique_ostream compress(unique_ostream&&, Compression);
+
 bool streq(const char* const a, const char* const b) {
   return strcmp(a, b) == 0;
 }
@@ -58,20 +202,30 @@ bool match_argument(const char* const argument,
   return streq(argument, short_name) || streq(argument, long_name);
 }
 
-std::tuple<std::vector<Input>, unique_ostream>
-  parse_arguments(int count, const char* const* begin) {
+Arguments parse_arguments(int count, const char* const* begin) {
   using namespace std;
   const char* const stdin_name = "STDIN";
   --count;
   ++begin;
-  vector<Input> inputs;
-  unique_ostream output;
-  bool enable_parsing = true;
+  Arguments arguments = { vector<Input>(), unique_ostream(),
+    vector<Section>(), COMPILE,
+    NO_REPORT, false, string(), string(), string(), string(), '\0', false,
+    0, size_t(1) << 26, true,
+    vector<shared_ptr<ComparingBuffer>>() };
+  auto& inputs = arguments.inputs;
+  auto& action = arguments.action;
+  const char* output_path = nullptr;
+  bool transpose_memory = false;
+  vector<pair<string, const char*>> section_paths;
+  bool enable_parsing = true, asynchronous = false, direct = false,
+    mapped = false;
+  Compression compression = NO_COMPRESSION;
+  Overwrite overwrite = ALWAYS_OVERWRITE;
+  const char* verify_path = nullptr;
   const auto end = begin + count;
   for (auto argument = begin; argument != end; ++argument) {
     if (!enable_parsing) {
-      inputs.push_back(Input(*argument,
-        unique_istream(new ifstream(*argument, ios::binary))));
+      inputs.push_back(Input(*argument, unique_istream()));
       continue;
     }
     if (match_argument(*argument, "-h", "--help")) {
@@ -83,12 +237,108 @@ std::tuple<std::vector<Input>, unique_ostream>
       inputs.push_back(Input(*argument,
         unique_istream(new istringstream(*argument))));
     } else if (match_argument(*argument, "-o", "--output")) {
-      if (output)
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      const auto value = *++argument;
+      const auto name = section_name(value);
+      if (!name.empty())
+        section_paths.push_back(make_pair(name, value + name.size() + 1));
+      else if (output_path)
+        throw excessive_value(*(argument - 1));
+      else
+        output_path = value;
+    } else if (streq(*argument, "--cache")) {
+      if (!arguments.cache.empty())
         throw excessive_value(*argument);
       if (argument + 1 == end)
         throw missing_value(*argument);
-      ++argument;
-      output.reset(new ofstream(*argument, ios::binary));
+      arguments.cache = *++argument;
+      if (mkdir(arguments.cache.c_str(), 0777) == -1 && errno != EEXIST)
+        throw uncreatable_cache(arguments.cache);
+    } else if (streq(*argument, "--io-uring")) {
+      asynchronous = true;
+    } else if (streq(*argument, "--direct")) {
+      direct = true;
+    } else if (streq(*argument, "--mmap")) {
+      mapped = true;
+    } else if (streq(*argument, "--compress")
+      || streq(*argument, "--compress=lz4")) {
+      compression = LZ4_COMPRESSION;
+    } else if (streq(*argument, "--compress=zstd")) {
+#ifndef PROTODATA_ZSTD
+      throw unavailable_option(*argument);
+#endif
+      compression = ZSTD_COMPRESSION;
+    } else if (streq(*argument, "--no-opt")) {
+      arguments.optimize = false;
+    } else if (streq(*argument, "--verify")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      action = VERIFY;
+      verify_path = *++argument;
+    } else if (streq(*argument, "--write-if-changed")) {
+      overwrite = OVERWRITE_IF_CHANGED;
+    } else if (streq(*argument, "--check")) {
+      action = CHECK;
+    } else if (streq(*argument, "--size")) {
+      action = SIZE;
+    } else if (streq(*argument, "--decode")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      action = DECODE;
+      arguments.decode = *++argument;
+    } else if (streq(*argument, "--emit-cpp")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      action = EMIT_CPP;
+      arguments.emit = *++argument;
+      // The name must be an identifier, as a section's is.
+      if (section_name(join(arguments.emit, '=').c_str()).empty())
+        throw invalid_value(*(argument - 1));
+    } else if (streq(*argument, "--columns")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      arguments.columns = *++argument;
+      if (arguments.columns.empty())
+        throw invalid_value("--columns");
+    } else if (streq(*argument, "--delimiter")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      const string delimiter = *++argument;
+      arguments.delimiter = delimiter == "\\t" ? '\t' : delimiter[0];
+      if ((delimiter.size() != 1 && delimiter != "\\t")
+        || isalnum(static_cast<unsigned char>(arguments.delimiter))
+        || strchr("+-.#\n\r ", arguments.delimiter))
+        throw invalid_delimiter(delimiter);
+    } else if (streq(*argument, "--align")) {
+      arguments.align = true;
+    } else if (streq(*argument, "--transpose")) {
+      arguments.transpose = 1;
+    } else if (strncmp(*argument, "--transpose=", 12) == 0) {
+      char* stop;
+      arguments.transpose = strtoull(*argument + 12, &stop, 10);
+      if (*stop || arguments.transpose == 0)
+        throw invalid_value(*argument);
+    } else if (streq(*argument, "--transpose-memory")) {
+      if (argument + 1 == end)
+        throw missing_value(*argument);
+      char* stop;
+      arguments.transpose_memory = strtoull(*++argument, &stop, 10);
+      if (!**argument || *stop || arguments.transpose_memory == 0)
+        throw invalid_value("--transpose-memory");
+      transpose_memory = true;
+    } else if (streq(*argument, "--stats")
+      || streq(*argument, "--stats=json")
+      || streq(*argument, "--stats-counters")) {
+#ifdef PROTODATA_NO_STATS
+      throw unavailable_option(*argument);
+#endif
+      if (streq(*argument, "--stats-counters"))
+        arguments.counters = true;
+      if (streq(*argument, "--stats=json"))
+        arguments.report = JSON_REPORT;
+      else if (arguments.report == NO_REPORT)
+        arguments.report = TEXT_REPORT;
     } else if (streq(*argument, "-")) {
       inputs.push_back(Input(stdin_name, unique_istream(&cin)));
     } else if (streq(*argument, "--")) {
@@ -96,13 +346,160 @@ std::tuple<std::vector<Input>, unique_ostream>
     } else if (**argument == '-') {
       throw unknown_option(*argument);
     } else {
-      inputs.push_back(Input(*argument,
-        unique_istream(new ifstream(*argument, ios::binary))));
+      inputs.push_back(Input(*argument, unique_istream()));
     }
   }
+  if (arguments.columns.empty() && arguments.delimiter)
+    throw dependent_option("--delimiter", "--columns");
+  if (arguments.columns.empty() && arguments.align)
+    throw dependent_option("--align", "--columns");
+  if (arguments.columns.empty() && arguments.transpose)
+    throw dependent_option("--transpose", "--columns");
+  if (arguments.align && arguments.transpose)
+    throw conflicting_options("--align", "--transpose");
+  if (transpose_memory && !arguments.transpose)
+    throw dependent_option("--transpose-memory", "--transpose");
+  // Templates have no sections; their output is only the
+  // main output, which the generated code writes.
+  if (action == EMIT_CPP && !arguments.columns.empty())
+    throw conflicting_options("--emit-cpp", "--columns");
+  if (action == EMIT_CPP && !section_paths.empty())
+    throw conflicting_options("--emit-cpp", "-o NAME=OUT");
+  if (action == VERIFY) {
+    if (output_path)
+      throw conflicting_options("--verify", "-o");
+    if (overwrite != ALWAYS_OVERWRITE)
+      throw conflicting_options("--verify", "--write-if-changed");
+    output_path = verify_path;
+    overwrite = NEVER_OVERWRITE;
+  }
+  if (overwrite == OVERWRITE_IF_CHANGED && !output_path)
+    throw dependent_option("--write-if-changed", "-o");
+  // Files are opened once it's known whether they're source,
+  // which may be compressed, or binary to be decoded as it is.
+  for (auto& input : inputs)
+    if (!input.stream)
+      input = open_input(input.name, action != DECODE);
   if (inputs.empty())
     inputs.push_back(Input(stdin_name, unique_istream(&cin)));
-  if (!output)
-    output.reset(&cout);
-  return make_tuple(move(inputs), move(output));
+  auto& output = arguments.output;
+  auto& compared = arguments.compared;
+  const bool writing = action != CHECK && action != SIZE;
+  for (const auto& section : section_paths) {
+    Section added = { section.first, unique_ostream() };
+    if (writing)
+      added.output = open_output(section.second, asynchronous, direct,
+        mapped, compression, overwrite, compared);
+    arguments.sections.push_back(move(added));
+  }
+  if (!writing)
+    return arguments;
+  if (output_path)
+    output = open_output(output_path, asynchronous, direct, mapped,
+      compression, overwrite, compared);
+  else
+    output = compress(unique_ostream
+      (new FileStream(STDOUT_FILENO, false, asynchronous, direct)),
+      compression);
+  return arguments;
+}
+
+// A regular file compressed with gzip or zstd is read through
+// a decompressor, if 'decompress' is set, and so isn't marked
+// as a file.
+Input open_input(const char* const path, const bool decompress) {
+  const auto file = decompress ? open(path, O_RDONLY) : -1;
+  if (file != -1) {
+    struct stat status;
+    DecompressedBuffer::Format format;
+    if (fstat(file, &status) == 0 && S_ISREG(status.st_mode)
+      && DecompressedBuffer::detect(file, format)) {
+#ifndef PROTODATA_ZSTD
+      if (format == DecompressedBuffer::ZSTD) {
+        close(file);
+        throw unsupported_input(path, "zstd");
+      }
+#endif
+      return Input(path, unique_istream(new DecompressedStream(file, format)));
+    }
+    close(file);
+  }
+  return Input(path,
+    unique_istream(new std::ifstream(path, std::ios::binary)), true);
+}
+
+// The name of the section in an output of the form
+// 'NAME=PATH', if any. Paths containing '=' can be given
+// as './NAME=PATH'.
+std::string section_name(const char* const value) {
+  const auto equals = strchr(value, '=');
+  if (!equals || equals == value
+    || !(isalpha(static_cast<unsigned char>(*value)) || *value == '_'))
+    return std::string();
+  for (auto here = value; here != equals; ++here)
+    if (!isalnum(static_cast<unsigned char>(*here)) && *here != '_')
+      return std::string();
+  return std::string(value, equals);
+}
+
+// Opens an output file, which is compressed if its extension
+// is that of a compressed format. Output compared with an
+// existing file is added to 'compared', to be finished once
+// it has all been written.
+unique_ostream open_output(const char* const path, const bool asynchronous,
+  const bool direct, const bool mapped, Compression compression,
+  const Overwrite overwrite,
+  std::vector<std::shared_ptr<ComparingBuffer>>& compared) {
+  const auto ends_with = [path](const char* const suffix) {
+    const auto length = strlen(path), suffix_length = strlen(suffix);
+    return length >= suffix_length
+      && streq(path + length - suffix_length, suffix);
+  };
+  if (ends_with(".lz4"))
+    compression = LZ4_COMPRESSION;
+  if (ends_with(".zst")) {
+#ifndef PROTODATA_ZSTD
+    throw unavailable_option(join("-o ", path));
+#endif
+    compression = ZSTD_COMPRESSION;
+  }
+  // Verified output isn't compressed, so that a difference can
+  // be reported at its offset. Anything but a regular file is
+  // always written.
+  if (overwrite == NEVER_OVERWRITE && compression != NO_COMPRESSION)
+    throw conflicting_options("--verify", "--compress");
+  struct stat status;
+  if (overwrite == NEVER_OVERWRITE || (overwrite == OVERWRITE_IF_CHANGED
+    && (stat(path, &status) != 0 || S_ISREG(status.st_mode)))) {
+    compared.push_back(std::make_shared<ComparingBuffer>(path,
+      overwrite == NEVER_OVERWRITE ? ComparingBuffer::VERIFY
+        : ComparingBuffer::WRITE_IF_CHANGED, asynchronous, direct));
+    return compress(unique_ostream(new ComparingStream(compared.back())),
+      compression);
+  }
+  // Shared mappings must be readable as well as writable.
+  const auto file = open(path,
+    (mapped ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0666);
+  if (file == -1)
+    throw unopenable_output(path);
+  if (mapped && fstat(file, &status) == 0 && S_ISREG(status.st_mode))
+    return compress(unique_ostream(new MappedStream(file, true)),
+      compression);
+  return compress(unique_ostream
+    (new FileStream(file, true, asynchronous, direct)), compression);
+}
+
+unique_ostream compress(unique_ostream&& output,
+  const Compression compression) {
+  switch (compression) {
+  case NO_COMPRESSION:
+    break;
+  case LZ4_COMPRESSION:
+    return unique_ostream
+      (new CompressedStream(std::move(output), CompressedBuffer::LZ4));
+  case ZSTD_COMPRESSION:
+    return unique_ostream
+      (new CompressedStream(std::move(output), CompressedBuffer::ZSTD));
+  }
+  return std::move(output);
 }
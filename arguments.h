@@ -5,20 +5,72 @@
 
 #include <iosfwd>
 #include <memory>
-#include <tuple>
+#include <string>
 #include <vector>
 
+class ComparingBuffer;
+
 typedef std::unique_ptr<std::istream, istream_deleter> unique_istream;
 typedef std::unique_ptr<std::ostream, ostream_deleter> unique_ostream;
 
+// An input, which is a file if 'file' is set, in which case
+// 'name' is its path.
 struct Input {
-  Input(const char* name, unique_istream&& stream)
-    : name(name), stream(std::move(stream)) {}
+  Input(const char* name, unique_istream&& stream, const bool file = false)
+    : name(name), stream(std::move(stream)), file(file) {}
   const char* name;
   unique_istream stream;
+  bool file;
+};
+
+// What to do with the input: compile it, only check that it
+// is valid, print the size of its output, compare its output
+// with a file, decode it from binary back to source, or
+// generate C++ code that writes its output.
+enum Action {
+  COMPILE,
+  CHECK,
+  SIZE,
+  VERIFY,
+  DECODE,
+  EMIT_CPP,
+};
+
+// How to report statistics, if at all.
+enum Report {
+  NO_REPORT,
+  TEXT_REPORT,
+  JSON_REPORT,
+};
+
+// A named output section, which is only counted if 'output'
+// is null.
+struct Section {
+  std::string name;
+  unique_ostream output;
+};
+
+struct Arguments {
+  std::vector<Input> inputs;
+  unique_ostream output;
+  std::vector<Section> sections;
+  Action action;
+  Report report;
+  bool counters;
+  std::string cache;
+  std::string decode;
+  std::string emit;
+  std::string columns;
+  char delimiter;
+  bool align;
+  size_t transpose;
+  size_t transpose_memory;
+  bool optimize;
+  // Outputs compared with existing files, which are finished
+  // once everything has been written to them.
+  std::vector<std::shared_ptr<ComparingBuffer>> compared;
 };
 
-std::tuple<std::vector<Input>, unique_ostream>
-  parse_arguments(int, const char* const*);
+Arguments parse_arguments(int, const char* const*);
 
 #endif
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Compares benchmark results against a baseline, failing if
+# the throughput of any benchmark in both has fallen by more
+# than TOLERANCE percent.
+
+if [ "$#" -lt 2 ]; then
+  echo "Usage: compare.sh BASELINE RESULTS [TOLERANCE]" >&2
+  exit 1
+fi
+
+awk -v tolerance="${3:-10}" '
+  function field(line, name,    pattern) {
+    pattern = "\"" name "\": \"?[^,\"}]*"
+    if (!match(line, pattern))
+      return ""
+    line = substr(line, RSTART + length(name) + 4, RLENGTH - length(name) - 4)
+    sub(/^"/, "", line)
+    return line
+  }
+  FNR == NR {
+    baseline[field($0, "benchmark")] = field($0, "mb_per_s")
+    next
+  }
+  {
+    name = field($0, "benchmark")
+    if (!(name in baseline))
+      next
+    change = (field($0, "mb_per_s") / baseline[name] - 1) * 100
+    printf "%-40s %+7.1f%%\n", name, change
+    if (change < -tolerance) {
+      printf "Benchmark \"%s\" regressed by more than %s%%.\n",
+        name, tolerance > "/dev/stderr"
+      failed = 1
+    }
+  }
+  END { exit failed }
+' "$1" "$2"
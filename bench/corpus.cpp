@@ -0,0 +1,229 @@
+// Generates deterministic Protodata source for benchmarking.
+//
+//     corpus SCENARIO SIZE [SEED]
+//
+// Writes about SIZE bytes of source to standard output, and
+// the number of values it encodes to standard error.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// xorshift64*, so that a seed gives the same corpus anywhere.
+class Random {
+public:
+  explicit Random(const uint64_t seed) : state(seed ? seed : 1) {}
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dull;
+  }
+  uint64_t below(const uint64_t bound) { return next() % bound; }
+private:
+  uint64_t state;
+};
+
+// Accumulates output a line at a time.
+class Output {
+public:
+  Output() : written(0), values(0) {}
+  void add(const std::string& text) { line += text; }
+  // Adds a space-separated word.
+  void word(const std::string& text) {
+    if (!line.empty() && line[line.size() - 1] != ' ')
+      line += ' ';
+    line += text;
+  }
+  void value(const std::string& text) {
+    word(text);
+    ++values;
+  }
+  void end() {
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), stdout);
+    written += line.size();
+    line.clear();
+  }
+  uint64_t written;
+  uint64_t values;
+private:
+  std::string line;
+};
+
+std::string format(const char* const pattern, ...)
+  __attribute__((format(printf, 1, 2)));
+
+std::string format(const char* const pattern, ...) {
+  char buffer[64];
+  va_list arguments;
+  va_start(arguments, pattern);
+  std::vsnprintf(buffer, sizeof(buffer), pattern, arguments);
+  va_end(arguments);
+  return buffer;
+}
+
+// Mostly f32 data, with some f64 and bf16.
+void floats(Random& random, Output& output) {
+  static const char* const types[] = { "f32", "f32", "f32", "f64", "bf16" };
+  output.word(types[random.below(5)]);
+  for (int i = 0; i < 8; ++i) {
+    // The lexer doesn't accept exponents, so precision varies
+    // with magnitude instead.
+    const double magnitude = double(random.next() >> 11) / (1ull << 53);
+    const int exponent = int(random.below(9)) - 3;
+    output.value(format("%.*f", 6 - std::min(exponent, 3),
+      (random.below(2) ? -1 : 1) * magnitude * std::pow(10.0, exponent)));
+  }
+  output.end();
+}
+
+// Integers of every width, in decimal, hex, and binary.
+void integers(Random& random, Output& output) {
+  static const int widths[] = { 8, 16, 32, 64 };
+  const int width = widths[random.below(4)];
+  const bool is_signed = random.below(2);
+  const uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+  output.word(format("%c%d", is_signed ? 's' : 'u', width));
+  for (int i = 0; i < 12; ++i) {
+    const uint64_t value = random.next() & (mask >> (is_signed ? 1 : 0));
+    if (is_signed)
+      output.value(format("%c%llu", random.below(2) ? '-' : '+',
+        (unsigned long long)value));
+    else if (random.below(4) == 0)
+      output.value(format("0x%llx", (unsigned long long)value));
+    else if (width == 8 && random.below(4) == 0)
+      output.value(format("0b%d%d%d%d_%d%d%d%d", int(value >> 7 & 1),
+        int(value >> 6 & 1), int(value >> 5 & 1), int(value >> 4 & 1),
+        int(value >> 3 & 1), int(value >> 2 & 1), int(value >> 1 & 1),
+        int(value & 1)));
+    else
+      output.value(format("%llu", (unsigned long long)value));
+  }
+  output.end();
+}
+
+// Mixed-script UTF-8 strings, reencoded as UTF-16. Each rune
+// written counts as a value.
+void strings(Random& random, Output& output) {
+  static const char* const words[] = {
+    "protodata", "binary", "reëncode", "naïve", "façade", "Ωμέγα",
+    "Привет", "日本語", "데이터", "🙂", "\\n", "\\\"", "\\t",
+  };
+  static const int runes[] = { 9, 6, 8, 5, 6, 5, 6, 3, 3, 1, 1, 1, 1 };
+  output.add("utf16 big \"");
+  for (int i = 0; i < 10; ++i) {
+    if (i != 0) {
+      output.add(" ");
+      ++output.values;
+    }
+    const auto word = random.below(sizeof(runes) / sizeof(*runes));
+    output.add(words[word]);
+    output.values += runes[word];
+  }
+  output.add("\"");
+  output.end();
+}
+
+// Bit fields of odd widths, 32 bits to a line so that the
+// output stays byte-aligned.
+void bits(Random& random, Output& output) {
+  static const int widths[] = { 3, 5, 7, 1, 11, 5 };
+  for (const auto width : widths) {
+    output.word(format("u%d", width));
+    output.value(format("%llu",
+      (unsigned long long)(random.next() & ((1ull << width) - 1))));
+  }
+  output.end();
+}
+
+// A value for every few lines of commentary.
+void comments(Random& random, Output& output) {
+  static const char* const remarks[] = {
+    "# The following field is the record identifier.",
+    "# Reserved for future use; must be zero.",
+    "# Offsets are relative to the start of the section.",
+    "# See the format specification, section 4.2.",
+  };
+  const auto lines = 1 + random.below(4);
+  for (uint64_t i = 0; i < lines; ++i) {
+    output.add(remarks[random.below(4)]);
+    output.end();
+  }
+  output.word("u16");
+  output.value(format("%llu", (unsigned long long)random.below(65536)));
+  output.word("# trailing");
+  output.end();
+}
+
+// Deeply nested groups, each changing the state.
+void braces(Random& random, Output& output) {
+  static const char* const types[] = {
+    "u8", "u16 big", "s32 little", "u64", "f32", "utf8",
+  };
+  const auto depth = 16 + random.below(48);
+  for (uint64_t i = 0; i < depth; ++i) {
+    output.word("{");
+    output.word(types[random.below(6)]);
+    output.value(format("%llu", (unsigned long long)random.below(100)));
+  }
+  for (uint64_t i = 0; i < depth; ++i)
+    output.add("}");
+  output.end();
+}
+
+struct Scenario {
+  const char* name;
+  void (*line)(Random&, Output&);
+};
+
+const Scenario scenarios[] = {
+  { "floats", floats },
+  { "integers", integers },
+  { "strings", strings },
+  { "bits", bits },
+  { "comments", comments },
+  { "braces", braces },
+};
+
+// Accepts a size with an optional K, M, or G suffix.
+uint64_t parse_size(const char* const text) {
+  char* end;
+  uint64_t size = std::strtoull(text, &end, 10);
+  switch (*end) {
+  case 'G': size <<= 10;
+  case 'M': size <<= 10;
+  case 'K': size <<= 10;
+  }
+  return size;
+}
+
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3 || argc > 4) {
+    std::fprintf(stderr, "Usage: %s SCENARIO SIZE [SEED]\n", argv[0]);
+    return 1;
+  }
+  const Scenario* scenario = nullptr;
+  for (const auto& candidate : scenarios)
+    if (std::strcmp(candidate.name, argv[1]) == 0)
+      scenario = &candidate;
+  if (!scenario) {
+    std::fprintf(stderr, "Unknown scenario: '%s'.\n", argv[1]);
+    return 1;
+  }
+  const auto size = parse_size(argv[2]);
+  Random random(argc == 4 ? std::strtoull(argv[3], nullptr, 10) : 1);
+  Output output;
+  while (output.written < size)
+    scenario->line(random, output);
+  std::fprintf(stderr, "%llu\n", (unsigned long long)output.values);
+}
@@ -0,0 +1,152 @@
+// Microbenchmarks of the innermost encoding and parsing steps.
+//
+//     micro [ITERATIONS]
+//
+// Prints one JSON object per line, in the same form as
+// 'bench/run.sh'.
+
+#include <Stream.h>
+#include <parse.h>
+#include <write.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Discards its output, so that only encoding is measured.
+class NullBuffer : public std::streambuf {
+protected:
+  int_type overflow(const int_type character) override {
+    return traits_type::not_eof(character);
+  }
+  std::streamsize xsputn(const char*, const std::streamsize size) override {
+    return size;
+  }
+};
+
+// Keeps results alive, so that the work isn't optimized away.
+volatile uint64_t sink;
+
+// Runs 'body' with the number of values to process, and
+// reports the best of a few runs. 'size' is the number of
+// bytes each value takes as input or output.
+template<class F>
+void measure(const char* const name, const uint64_t values,
+  const double size, F body) {
+  typedef std::chrono::steady_clock Clock;
+  double best = 0;
+  for (int run = 0; run < 3; ++run) {
+    const auto start = Clock::now();
+    body(values);
+    const double seconds
+      = std::chrono::duration<double>(Clock::now() - start).count();
+    if (run == 0 || seconds < best)
+      best = seconds;
+  }
+  std::printf("{\"benchmark\": \"micro/%s\", \"bytes\": %.0f, "
+    "\"values\": %llu, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+    "\"values_per_s\": %.0f}\n", name, values * size,
+    (unsigned long long)values, best, values * size / best / 1e6,
+    values / best);
+}
+
+// Literal tokens of a kind, cycled through by the parsing
+// benchmarks.
+std::vector<std::string> literals(const char* const pattern, const int count,
+  const uint64_t modulus) {
+  std::vector<std::string> result;
+  uint64_t value = 0x9e3779b97f4a7c15ull;
+  for (int i = 0; i < count; ++i) {
+    value = value * 6364136223846793005ull + 1442695040888963407ull;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), pattern,
+      (unsigned long long)(value >> 16) % modulus, int(i % 1000));
+    result.push_back(buffer);
+  }
+  return result;
+}
+
+template<class T>
+void endian_copies(const char* const name, const uint64_t values,
+  const Term::Endianness endianness) {
+  NullBuffer buffer;
+  std::ostream stream(&buffer);
+  measure(name, values, sizeof(T), [&](const uint64_t count) {
+    Stream output(stream);
+    for (uint64_t i = 0; i < count; ++i)
+      endian_copy(T(i), endianness, output);
+  });
+}
+
+void parse_literals(const char* const name, const uint64_t values,
+  const std::vector<std::string>& tokens, const int base) {
+  size_t size = 0;
+  for (const auto& token : tokens)
+    size += token.size();
+  measure(name, values, double(size) / tokens.size(),
+    [&](const uint64_t count) {
+      uint64_t types = 0;
+      for (uint64_t i = 0; i < count; ++i) {
+        const auto& token = tokens[i % tokens.size()];
+        types += base ? write_integer_term(token, base).type
+          : write_double_term(token).type;
+      }
+      sink = types;
+    });
+}
+
+}
+
+int main(int argc, char** argv) {
+  const uint64_t values = argc > 1
+    ? std::strtoull(argv[1], nullptr, 10) : 1 << 24;
+  NullBuffer buffer;
+  std::ostream stream(&buffer);
+
+  std::vector<uint8_t> block(4096);
+  for (size_t i = 0; i < block.size(); ++i)
+    block[i] = uint8_t(i * 31);
+  measure("stream_write_block", values / 256, block.size(),
+    [&](const uint64_t count) {
+      Stream output(stream);
+      const uint8_t* const data = &block[0];
+      for (uint64_t i = 0; i < count; ++i)
+        output.write(data, data + block.size());
+    });
+  measure("stream_write_byte", values, 1, [&](const uint64_t count) {
+    Stream output(stream);
+    for (uint64_t i = 0; i < count; ++i)
+      output.write(char(i));
+  });
+  // Six fields make up 32 bits.
+  measure("stream_write_bits", values, 32.0 / 6 / 8,
+    [&](const uint64_t count) {
+      static const int widths[] = { 3, 5, 7, 1, 11, 5 };
+      Stream output(stream);
+      for (uint64_t i = 0; i < count; i += 6)
+        for (const auto width : widths)
+          output.write(i & ((uint64_t(1) << width) - 1), width);
+    });
+
+  endian_copies<uint16_t>("endian_copy_u16_big", values, Term::BIG);
+  endian_copies<uint32_t>("endian_copy_u32_native", values, Term::NATIVE);
+  endian_copies<uint32_t>("endian_copy_u32_big", values, Term::BIG);
+  endian_copies<uint64_t>("endian_copy_u64_big", values, Term::BIG);
+  endian_copies<double>("endian_copy_f64_little", values, Term::LITTLE);
+
+  parse_literals("parse_decimal", values / 4,
+    literals("%llu", 4096, 1000000000), 10);
+  parse_literals("parse_hex", values / 4,
+    literals("0x%llx", 4096, 1ull << 32), 16);
+  parse_literals("parse_signed", values / 4,
+    literals("-%llu", 4096, 1 << 20), 10);
+  parse_literals("parse_float", values / 4,
+    literals("%llu.%03d", 4096, 100000), 0);
+}
@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Runs the benchmarks, writing one JSON object per line to
+# standard output and to '$BENCH_RESULTS'. Corpora are
+# generated once per scenario and size, and reused.
+#
+# Settings, from the environment:
+#
+#   BENCH_SCENARIOS  Corpus scenarios to run.
+#   BENCH_SIZES      Corpus sizes, with K, M, or G suffixes.
+#   BENCH_RUNS       Runs of each, of which the best is kept.
+#   BENCH_MICRO      Values per microbenchmark; 0 skips them.
+#   BENCH_BASELINE   Earlier results to compare against.
+#   BENCH_TOLERANCE  Allowed slowdown from the baseline, in
+#                    percent, before failing.
+
+set -e
+
+# Paths are taken relative to where this is run from.
+results="$(realpath -m "${BENCH_RESULTS:-$(dirname "$0")/results.json}")"
+baseline=
+if [ -n "$BENCH_BASELINE" ]; then
+  baseline="$(mktemp)"
+  trap 'rm -f "$baseline"' EXIT
+  cp "$BENCH_BASELINE" "$baseline"
+fi
+
+cd "$(dirname "$0")"
+
+scenarios="${BENCH_SCENARIOS:-floats integers strings bits comments braces}"
+sizes="${BENCH_SIZES:-1M 16M}"
+runs="${BENCH_RUNS:-3}"
+micro="${BENCH_MICRO:-16777216}"
+tolerance="${BENCH_TOLERANCE:-10}"
+
+for program in ../pd ./corpus ./micro; do
+  if [ ! -x "$program" ]; then
+    echo "Unable to run benchmarks; missing '$program'." >&2
+    exit 1
+  fi
+done
+
+mkdir -p data
+: > "$results"
+
+function report {
+  echo "$1" | tee -a "$results"
+}
+
+for size in $sizes; do
+  for scenario in $scenarios; do
+    source="data/$scenario-$size.pd"
+    if [ ! -e "$source" ]; then
+      ./corpus "$scenario" "$size" > "$source.tmp" 2> "$source.values"
+      mv "$source.tmp" "$source"
+    fi
+    bytes="$(stat -c %s "$source")"
+    values="$(cat "$source.values")"
+    best=
+    for ((run = 0; run < runs; ++run)); do
+      start="$EPOCHREALTIME"
+      ../pd "$source" -o /dev/null
+      end="$EPOCHREALTIME"
+      best="$(awk -v start="$start" -v end="$end" -v best="$best" \
+        'BEGIN { t = end - start; print (best == "" || t < best) ? t : best }')"
+    done
+    report "$(awk -v name="$scenario-$size" -v bytes="$bytes" \
+      -v values="$values" -v seconds="$best" 'BEGIN {
+        printf "{\"benchmark\": \"corpus/%s\", \"bytes\": %d, " \
+          "\"values\": %d, \"seconds\": %.6f, \"mb_per_s\": %.2f, " \
+          "\"values_per_s\": %.0f}\n", name, bytes, values, seconds,
+          bytes / seconds / 1e6, values / seconds
+      }')"
+  done
+done
+
+if [ "$micro" != 0 ]; then
+  ./micro "$micro" | while read -r line; do
+    report "$line"
+  done
+fi
+
+if [ -n "$baseline" ]; then
+  ./compare.sh "$baseline" "$results" "$tolerance"
+fi
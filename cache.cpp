@@ -0,0 +1,208 @@
+#include <cache.h>
+
+#include <Digest.h>
+#include <Interpreter.h>
+#include <parse.h>
+#include <util.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// An entry is the recorded output of an input, followed by a
+// trailer: the snapshot at its end, the size of the snapshot,
+// and this tag.
+const char entry_tag[8] = { 'p', 'd', 'c', 'a', 'c', 'h', 'e', '1' };
+
+const std::string& build();
+std::string key(const Interpreter::Snapshot&, const std::string&);
+std::string serialize(const Interpreter::Snapshot&);
+bool deserialize(const std::string&, Interpreter::Snapshot&);
+bool load(const std::string&, Interpreter::Snapshot&, uint64_t&);
+
+template<class T>
+void append(std::string& output, const T value) {
+  output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<class T>
+bool extract(const std::string& input, size_t& offset, T& value) {
+  if (input.size() - offset < sizeof(value))
+    return false;
+  input.copy(reinterpret_cast<char*>(&value), sizeof(value), offset);
+  offset += sizeof(value);
+  return true;
+}
+
+}
+
+// Parses an input, or, if it was compiled before from the
+// same source and interpreter state, splices in its recorded
+// output from the cache in 'directory'. The cache is only an
+// optimization: entries that can't be read or written are
+// ignored, and the directory may be removed at any time.
+void parse_cached(std::istream& input, Interpreter& interpreter,
+  const std::string& directory, const bool optimize) {
+  const std::string source((std::istreambuf_iterator<char>(input)),
+    std::istreambuf_iterator<char>());
+  std::istringstream buffered(source);
+  Interpreter::Snapshot before, after;
+  if (build().empty() || !interpreter.snapshot(before)) {
+    parse(buffered, interpreter, optimize);
+    return;
+  }
+  const auto path = join(directory, '/', key(before, source));
+  uint64_t size;
+  if (load(path, after, size)) {
+    interpreter.replay(after, path.c_str(), size);
+    return;
+  }
+  const auto temporary = join(path, '.', getpid());
+  std::ofstream recording(temporary, std::ios::binary);
+  interpreter.record(&recording);
+  try {
+    parse(buffered, interpreter, optimize);
+  } catch (...) {
+    interpreter.record(nullptr);
+    std::remove(temporary.c_str());
+    throw;
+  }
+  interpreter.record(nullptr);
+  if (interpreter.replayable() && interpreter.snapshot(after)) {
+    std::string trailer = serialize(after);
+    append(trailer, uint64_t(trailer.size()));
+    trailer.append(entry_tag, sizeof(entry_tag));
+    recording.write(trailer.data(), trailer.size());
+    recording.close();
+    if (recording && std::rename(temporary.c_str(), path.c_str()) == 0)
+      return;
+  }
+  std::remove(temporary.c_str());
+}
+
+namespace {
+
+// Entries made by another build are never reused, since its
+// encoding may differ, so they are keyed by a hash of the
+// executable, or not made at all if it can't be read.
+const std::string& build() {
+  static const std::string hash = [] {
+    std::ifstream executable("/proc/self/exe", std::ios::binary);
+    Digest digest(Term::XXH64);
+    std::vector<char> buffer(1 << 16);
+    while (executable) {
+      executable.read(buffer.data(), buffer.size());
+      digest.update(reinterpret_cast<const uint8_t*>(buffer.data()),
+        executable.gcount());
+    }
+    if (!executable.eof())
+      return std::string();
+    char name[20];
+    std::snprintf(name, sizeof(name), "%016llx",
+      static_cast<unsigned long long>(digest.value()));
+    return std::string(name);
+  }();
+  return hash;
+}
+
+// The key of an entry is a hash of the source and of the
+// state in which it was compiled.
+std::string key(const Interpreter::Snapshot& entry,
+  const std::string& source) {
+  Digest digest(Term::XXH64);
+  const std::string header = join(build(), '\0', serialize(entry));
+  digest.update(reinterpret_cast<const uint8_t*>(header.data()),
+    header.size());
+  digest.update(reinterpret_cast<const uint8_t*>(source.data()),
+    source.size());
+  char name[40];
+  std::snprintf(name, sizeof(name), "%016llx-%llx",
+    static_cast<unsigned long long>(digest.value()),
+    static_cast<unsigned long long>(source.size()));
+  return name;
+}
+
+std::string serialize(const Interpreter::Snapshot& snapshot) {
+  std::string result;
+  append(result, uint64_t(snapshot.states.size()));
+  for (const auto& state : snapshot.states) {
+    append(result, uint64_t(state.width));
+    append(result, uint64_t(state.endianness));
+    append(result, uint64_t(state.signedness));
+    append(result, uint64_t(state.format));
+    append(result, uint64_t(state.reference));
+  }
+  append(result, uint64_t(snapshot.base.reference));
+  append(result, uint64_t(snapshot.base.value));
+  append(result, uint64_t(snapshot.bits.size()));
+  result.append(snapshot.bits.begin(), snapshot.bits.end());
+  return result;
+}
+
+bool deserialize(const std::string& input, Interpreter::Snapshot& snapshot) {
+  size_t offset = 0;
+  uint64_t count;
+  if (!extract(input, offset, count) || count == 0
+    || count > input.size() / (5 * sizeof(uint64_t)))
+    return false;
+  snapshot.states.resize(count);
+  for (auto& state : snapshot.states) {
+    uint64_t fields[5];
+    for (auto& field : fields)
+      if (!extract(input, offset, field))
+        return false;
+    // States are packed, so fields out of range are refused.
+    if (fields[0] == 0 || fields[0] > 64 || fields[1] > Term::BIG
+      || fields[2] > Term::SIGNED || fields[3] > Term::PREFIX_VARINT
+      || fields[4] > Term::FRAME)
+      return false;
+    state.width = Term::Width(fields[0]);
+    state.endianness = Term::Endianness(fields[1]);
+    state.signedness = Term::Signedness(fields[2]);
+    state.format = Term::Format(fields[3]);
+    state.reference = Term::Reference(fields[4]);
+  }
+  uint64_t reference;
+  if (!extract(input, offset, reference) || reference > Term::FRAME
+    || !extract(input, offset, snapshot.base.value))
+    return false;
+  snapshot.base.reference = Term::Reference(reference);
+  if (!extract(input, offset, count) || count != input.size() - offset)
+    return false;
+  snapshot.bits.assign(input.begin() + offset, input.end());
+  return true;
+}
+
+// Reads the trailer of an entry, if there is one, and the
+// size of the output before it.
+bool load(const std::string& path, Interpreter::Snapshot& snapshot,
+  uint64_t& size) {
+  std::ifstream entry(path, std::ios::binary | std::ios::ate);
+  if (!entry)
+    return false;
+  const uint64_t total = entry.tellg();
+  uint64_t trailer_size;
+  char tag[sizeof(entry_tag)];
+  const uint64_t fixed = sizeof(trailer_size) + sizeof(tag);
+  if (total < fixed
+    || !entry.seekg(total - fixed)
+    || !entry.read(reinterpret_cast<char*>(&trailer_size),
+      sizeof(trailer_size))
+    || !entry.read(tag, sizeof(tag))
+    || !std::equal(tag, tag + sizeof(tag), entry_tag)
+    || trailer_size > total - fixed)
+    return false;
+  std::string trailer(trailer_size, '\0');
+  size = total - fixed - trailer_size;
+  return entry.seekg(size) && entry.read(&trailer[0], trailer.size())
+    && deserialize(trailer, snapshot);
+}
+
+}
@@ -0,0 +1,11 @@
+#ifndef PROTODATA_CACHE_H
+#define PROTODATA_CACHE_H
+
+#include <iosfwd>
+#include <string>
+
+class Interpreter;
+
+void parse_cached(std::istream&, Interpreter&, const std::string&, bool);
+
+#endif
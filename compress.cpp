@@ -0,0 +1,97 @@
+#include <compress.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const size_t min_match = 4;
+// The last match must begin this many bytes before the end
+// of a block, and the last literals must be at least so long.
+const size_t match_limit = 12;
+const size_t last_literals = 5;
+const size_t max_offset = 65535;
+const int hash_bits = 16;
+
+uint32_t read32(const uint8_t* const data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t hash(const uint32_t value) {
+  return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+// Lengths of 15 or more continue in bytes of 255, ending
+// with a smaller one.
+uint8_t* write_length(size_t length, uint8_t* output) {
+  for (length -= 15; length >= 255; length -= 255)
+    *output++ = 255;
+  *output++ = uint8_t(length);
+  return output;
+}
+
+uint8_t* write_literals(const uint8_t* const literals, const size_t size,
+  uint8_t*& token, uint8_t* output) {
+  token = output++;
+  *token = uint8_t((size < 15 ? size : 15) << 4);
+  if (size >= 15)
+    output = write_length(size, output);
+  std::memcpy(output, literals, size);
+  return output + size;
+}
+
+}
+
+// Compresses one block in the LZ4 block format, by greedy
+// matching against the last position of each hashed word,
+// skipping ahead faster through data that doesn't match.
+// Returns the compressed size, which is at most
+// 'lz4_bound(size)'.
+size_t lz4_compress(const uint8_t* const input, const size_t size,
+  uint8_t* const output) {
+  uint8_t* out = output;
+  uint8_t* token;
+  size_t anchor = 0;
+  if (size > match_limit) {
+    std::vector<uint32_t> table(size_t(1) << hash_bits);
+    const size_t limit = size - match_limit;
+    const size_t end = size - last_literals;
+    size_t here = 0;
+    while (here < limit) {
+      const auto word = read32(input + here);
+      auto& slot = table[hash(word)];
+      size_t match = slot;
+      slot = uint32_t(here);
+      if (match >= here || here - match > max_offset
+        || read32(input + match) != word) {
+        here += 1 + ((here - anchor) >> 6);
+        continue;
+      }
+      while (here > anchor && match > 0
+        && input[here - 1] == input[match - 1]) {
+        --here;
+        --match;
+      }
+      size_t length = min_match;
+      while (here + length < end
+        && input[here + length] == input[match + length])
+        ++length;
+      out = write_literals(input + anchor, here - anchor, token, out);
+      const size_t offset = here - match;
+      *out++ = uint8_t(offset);
+      *out++ = uint8_t(offset >> 8);
+      const size_t extra = length - min_match;
+      *token |= uint8_t(extra < 15 ? extra : 15);
+      if (extra >= 15)
+        out = write_length(extra, out);
+      here += length;
+      anchor = here;
+      if (here - 2 < limit)
+        table[hash(read32(input + here - 2))] = uint32_t(here - 2);
+    }
+  }
+  out = write_literals(input + anchor, size - anchor, token, out);
+  return out - output;
+}
@@ -0,0 +1,14 @@
+#ifndef PROTODATA_COMPRESS_H
+#define PROTODATA_COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// The most that a block of 'size' bytes can compress to.
+inline size_t lz4_bound(const size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t lz4_compress(const uint8_t*, size_t, uint8_t*);
+
+#endif
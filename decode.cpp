@@ -0,0 +1,714 @@
+#include <decode.h>
+
+#include <parse.h>
+#include <shortest.h>
+#include <util.h>
+#include <write.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Lines are wrapped before this column.
+const size_t line_width = 78;
+
+// Source text, written to the output in blocks.
+class Text {
+public:
+  explicit Text(std::ostream& output)
+    : output(output), column(0), quoted(false) {
+    buffer.reserve(block_size);
+  }
+  Text(const Text&) = delete;
+  Text& operator=(const Text&) = delete;
+  void word(const char*, const char*);
+  void word(const std::string& text) {
+    word(text.data(), text.data() + text.size());
+  }
+  void rune(uint32_t);
+  void close();
+  void line();
+  void flush();
+private:
+  static const size_t block_size = 1 << 16;
+  void put(const char* const data, const size_t size) {
+    buffer.insert(buffer.end(), data, data + size);
+    column += size;
+    if (buffer.size() >= block_size)
+      flush();
+  }
+  std::ostream& output;
+  std::vector<char> buffer;
+  size_t column;
+  bool quoted;
+};
+
+// Decodes values in one state, writing them as source that
+// re-encodes to the same bytes. Values that have no literal
+// that would, such as NaNs with payloads and invalid UTF-8,
+// are written as raw unsigned integers instead.
+class Decoder {
+public:
+  Decoder(const Interpreter::State&, std::ostream&);
+  void decode(const uint8_t*, const uint8_t*);
+private:
+  void integers(const uint8_t*, const uint8_t*);
+  void bit_fields(const uint8_t*, const uint8_t*);
+  void floats(const uint8_t*, const uint8_t*);
+  void utf8(const uint8_t*, const uint8_t*);
+  void utf16(const uint8_t*, const uint8_t*);
+  void varints(const uint8_t*, const uint8_t*);
+  void integer(uint64_t);
+  void floating(uint64_t);
+  void raw_bytes(const uint8_t*, const uint8_t*);
+  void raw_bits(uint64_t, unsigned);
+  void raw_unit(uint64_t);
+  uint64_t read(const uint8_t*, size_t) const;
+  Interpreter::State state;
+  Interpreter::Base base;
+  Text text;
+  bool big;
+};
+
+std::string describe(const Interpreter::State&);
+char* decimal_literal(bool, Decimal, char*);
+char* format_unsigned(uint64_t, char*);
+size_t read_utf8(const uint8_t*, const uint8_t*, uint32_t&);
+size_t read_varint(Term::Format, const uint8_t*, const uint8_t*, uint64_t&);
+bool is_printable(uint32_t);
+
+}
+
+// Decodes the file at 'path', mapping it if it can be, or
+// else everything that can be read from 'input'.
+void decode(const char* const path, std::istream& input,
+  const Interpreter::State& state, std::ostream& output) {
+  const auto file = path ? open(path, O_RDONLY) : -1;
+  struct stat status;
+  if (file != -1 && fstat(file, &status) == 0 && S_ISREG(status.st_mode)) {
+    const size_t size = status.st_size;
+    const auto mapping = size == 0 ? MAP_FAILED
+      : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, size, MADV_SEQUENTIAL);
+      const auto begin = static_cast<const uint8_t*>(mapping);
+      try {
+        decode(begin, begin + size, state, output);
+      } catch (...) {
+        munmap(mapping, size);
+        throw;
+      }
+      munmap(mapping, size);
+      return;
+    }
+  } else if (file != -1) {
+    close(file);
+  }
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)),
+    std::istreambuf_iterator<char>());
+  decode(data.data(), data.data() + data.size(), state, output);
+}
+
+void decode(const uint8_t* const begin, const uint8_t* const end,
+  const Interpreter::State& state, std::ostream& output) {
+  Decoder(state, output).decode(begin, end);
+}
+
+namespace {
+
+void Text::word(const char* const begin, const char* const end) {
+  close();
+  if (column != 0 && column + (end - begin) + 1 > line_width)
+    line();
+  else if (column != 0)
+    put(" ", 1);
+  put(begin, end - begin);
+}
+
+// Writes a rune in a string literal, ending the literal after
+// newlines and at the end of a line.
+void Text::rune(const uint32_t rune) {
+  if (!quoted) {
+    word("\"", "\"" + 1);
+    quoted = true;
+  }
+  const char* escape = nullptr;
+  switch (rune) {
+  case U'"': escape = "\\\""; break;
+  case U'\\': escape = "\\\\"; break;
+  case U'\a': escape = "\\a"; break;
+  case U'\b': escape = "\\b"; break;
+  case U'\e': escape = "\\e"; break;
+  case U'\f': escape = "\\f"; break;
+  case U'\n': escape = "\\n"; break;
+  case U'\r': escape = "\\r"; break;
+  case U'\t': escape = "\\t"; break;
+  case U'\v': escape = "\\v"; break;
+  }
+  if (escape) {
+    put(escape, 2);
+  } else {
+    char encoded[4];
+    const auto encoded_end = utf8::append(rune, encoded);
+    put(encoded, encoded_end - encoded);
+  }
+  if (rune == U'\n' || column + 2 >= line_width) {
+    close();
+    line();
+  }
+}
+
+void Text::close() {
+  if (quoted) {
+    quoted = false;
+    put("\"", 1);
+  }
+}
+
+// Ends the line, if anything is on it.
+void Text::line() {
+  close();
+  if (column == 0)
+    return;
+  put("\n", 1);
+  column = 0;
+}
+
+void Text::flush() {
+  if (!buffer.empty() && !output.write(buffer.data(), buffer.size()))
+    throw std::runtime_error("Unable to write decoded output.");
+  buffer.clear();
+}
+
+Decoder::Decoder(const Interpreter::State& state, std::ostream& output)
+  : state(state), text(output),
+    big(state.endianness == Term::BIG || (state.endianness == Term::NATIVE
+      && platform_endianness() == Term::BIG)) {}
+
+void Decoder::decode(const uint8_t* const begin, const uint8_t* const end) {
+  text.word(describe(state));
+  text.line();
+  switch (state.format) {
+  case Term::INTEGER:
+    if (state.width == 8 || state.width == 16 || state.width == 32
+      || state.width == 64)
+      integers(begin, end);
+    else
+      bit_fields(begin, end);
+    break;
+  case Term::FLOAT:
+  case Term::BFLOAT:
+    floats(begin, end);
+    break;
+  case Term::UNICODE:
+    if (state.width == 8)
+      utf8(begin, end);
+    else
+      utf16(begin, end);
+    break;
+  case Term::ULEB128:
+  case Term::SLEB128:
+  case Term::ZIGZAG:
+  case Term::PREFIX_VARINT:
+    varints(begin, end);
+    break;
+  }
+  text.line();
+  text.flush();
+}
+
+void Decoder::integers(const uint8_t* here, const uint8_t* const end) {
+  const size_t size = state.width / 8;
+  const unsigned shift = 64 - state.width;
+  for (; size_t(end - here) >= size; here += size) {
+    const auto raw = read(here, size);
+    integer(state.signedness == Term::SIGNED
+      ? uint64_t(int64_t(raw << shift) >> shift) : raw);
+  }
+  raw_bytes(here, end);
+}
+
+// Odd widths are packed most significant bit first, without
+// regard to endianness.
+void Decoder::bit_fields(const uint8_t* const begin, const uint8_t* const end) {
+  const uint64_t bits = uint64_t(end - begin) * 8;
+  const unsigned width = state.width, shift = 64 - width;
+  uint64_t position = 0;
+  const auto take = [&](const unsigned count) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < count; ++i, ++position)
+      value = value << 1 | (begin[position / 8] >> (7 - position % 8) & 1);
+    return value;
+  };
+  while (bits - position >= width) {
+    const auto raw = take(width);
+    integer(state.signedness == Term::SIGNED
+      ? uint64_t(int64_t(raw << shift) >> shift) : raw);
+  }
+  // The remaining bits, which may only be padding, are written
+  // in widths that are always packed.
+  while (position != bits) {
+    const unsigned count = std::min<uint64_t>(bits - position, 7);
+    raw_bits(take(count), count);
+  }
+}
+
+void Decoder::floats(const uint8_t* here, const uint8_t* const end) {
+  const size_t size = state.width / 8;
+  for (; size_t(end - here) >= size; here += size)
+    floating(read(here, size));
+  raw_bytes(here, end);
+}
+
+void Decoder::utf8(const uint8_t* here, const uint8_t* const end) {
+  const uint8_t* invalid = here;
+  while (here != end) {
+    uint32_t rune;
+    const auto size = read_utf8(here, end, rune);
+    if (size == 0) {
+      ++here;
+      continue;
+    }
+    raw_bytes(invalid, here);
+    if (is_printable(rune)) {
+      text.rune(rune);
+    } else {
+      char digits[24], * const digits_end = digits + sizeof(digits);
+      text.word(format_unsigned(rune, digits_end), digits_end);
+    }
+    here += size;
+    invalid = here;
+  }
+  raw_bytes(invalid, end);
+}
+
+void Decoder::utf16(const uint8_t* here, const uint8_t* const end) {
+  for (; end - here >= 2; here += 2) {
+    const uint32_t unit = read(here, 2);
+    uint32_t rune = unit;
+    if (unit >= 0xd800 && unit < 0xdc00 && end - here >= 4) {
+      const uint32_t trail = read(here + 2, 2);
+      if (trail >= 0xdc00 && trail < 0xe000) {
+        rune = 0x10000 + ((unit - 0xd800) << 10) + (trail - 0xdc00);
+        here += 2;
+      }
+    }
+    if (rune >= 0xd800 && rune < 0xe000) {
+      raw_unit(unit);
+    } else if (is_printable(rune)) {
+      text.rune(rune);
+    } else {
+      char digits[24], * const digits_end = digits + sizeof(digits);
+      text.word(format_unsigned(rune, digits_end), digits_end);
+    }
+  }
+  raw_bytes(here, end);
+}
+
+// Encodings that aren't the shortest, or that don't fit in
+// 64 bits, are kept as raw bytes.
+void Decoder::varints(const uint8_t* here, const uint8_t* const end) {
+  while (here != end) {
+    uint64_t value;
+    const auto size = read_varint(state.format, here, end, value);
+    if (size == 0) {
+      raw_bytes(here, end);
+      return;
+    }
+    std::array<uint8_t, max_varint_size> encoded;
+    size_t encoded_size = 0;
+    switch (state.format) {
+    case Term::ULEB128:
+      encoded_size = encode_uleb128(value, &encoded[0]);
+      break;
+    case Term::SLEB128:
+      encoded_size = encode_sleb128(value, &encoded[0]);
+      break;
+    case Term::ZIGZAG:
+      encoded_size = encode_zigzag(value, &encoded[0]);
+      break;
+    default:
+      encoded_size = encode_prefix_varint(value, &encoded[0]);
+      break;
+    }
+    if (encoded_size == size && std::equal(here, here + size, &encoded[0]))
+      integer(value);
+    else
+      raw_bytes(here, here + size);
+    here += size;
+  }
+}
+
+// Writes the value that encodes to 'raw', which is sign-
+// extended in signed formats. In delta and frame of reference
+// modes, that is the sum of the difference and the base.
+void Decoder::integer(uint64_t raw) {
+  if (is_relative(state)) {
+    const bool first = base.reference != state.reference;
+    if (!first)
+      raw += base.value;
+    if (state.reference == Term::DELTA || first)
+      base.value = raw;
+    base.reference = state.reference;
+  }
+  char digits[24], * const end = digits + sizeof(digits);
+  char* begin;
+  if (is_signed(state) && int64_t(raw) < 0) {
+    begin = format_unsigned(-raw, end);
+    *--begin = '-';
+  } else {
+    begin = format_unsigned(raw, end);
+  }
+  text.word(begin, end);
+}
+
+void Decoder::floating(const uint64_t bits) {
+  char literal[48];
+  const auto end = float_literal(state, bits, literal);
+  if (end == literal)
+    raw_unit(bits);
+  else
+    text.word(literal, end);
+}
+
+void Decoder::raw_bytes(const uint8_t* here, const uint8_t* const end) {
+  if (here == end)
+    return;
+  text.word("{ absolute u8");
+  char digits[24], * const digits_end = digits + sizeof(digits);
+  for (; here != end; ++here)
+    text.word(format_unsigned(*here, digits_end), digits_end);
+  text.word("}");
+}
+
+void Decoder::raw_bits(const uint64_t value, const unsigned width) {
+  char digits[24], * const digits_end = digits + sizeof(digits);
+  text.word(join("{ absolute u", width));
+  text.word(format_unsigned(value, digits_end), digits_end);
+  text.word("}");
+}
+
+// A unit of the current width, written in the current
+// endianness.
+void Decoder::raw_unit(const uint64_t value) {
+  char digits[24], * const digits_end = digits + sizeof(digits);
+  text.word(join("{ absolute u", state.width));
+  text.word(format_unsigned(value, digits_end), digits_end);
+  text.word("}");
+}
+
+uint64_t Decoder::read(const uint8_t* const data, const size_t size) const {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; ++i)
+    value |= uint64_t(data[i]) << 8 * (big ? size - 1 - i : i);
+  return value;
+}
+
+// Commands that set the whole state, so that each decoded
+// input is independent of the one before it.
+std::string describe(const Interpreter::State& state) {
+  const char* const endianness = state.endianness == Term::BIG ? "big"
+    : state.endianness == Term::LITTLE ? "little" : "native";
+  const char* const reference = state.reference == Term::DELTA ? "delta"
+    : state.reference == Term::FRAME ? "for" : "absolute";
+  std::string type;
+  switch (state.format) {
+  case Term::INTEGER:
+    type = join(state.signedness == Term::SIGNED ? 's' : 'u', state.width);
+    break;
+  case Term::FLOAT:
+    type = join('f', state.width);
+    break;
+  case Term::BFLOAT:
+    type = "bf16";
+    break;
+  case Term::UNICODE:
+    type = state.width == 8 ? "utf8" : "utf16";
+    break;
+  case Term::ULEB128:
+    type = "uleb128";
+    break;
+  case Term::SLEB128:
+    type = "sleb128";
+    break;
+  case Term::ZIGZAG:
+    type = "zigzag";
+    break;
+  case Term::PREFIX_VARINT:
+    type = "prefix_varint";
+    break;
+  }
+  return join(endianness, ' ', reference, ' ', type);
+}
+
+double widen_half(const uint16_t bits) {
+  const int exponent = bits >> 10 & 0x1f;
+  const double magnitude = exponent == 0
+    ? std::ldexp(bits & 0x3ff, -24)
+    : exponent == 0x1f
+      ? (bits & 0x3ff ? std::numeric_limits<double>::quiet_NaN()
+        : std::numeric_limits<double>::infinity())
+      : std::ldexp((bits & 0x3ff) | 0x400, exponent - 25);
+  return bits & 0x8000 ? -magnitude : magnitude;
+}
+
+// The bits to which a float value is encoded in a state.
+uint64_t narrow(const Interpreter::State& state, const double value) {
+  if (state.format == Term::BFLOAT)
+    return bfloat_from_double(value);
+  if (state.width == 16)
+    return half_from_double(value);
+  if (state.width == 32) {
+    const float narrowed(value);
+    uint32_t bits;
+    std::memcpy(&bits, &narrowed, sizeof(bits));
+    return bits;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double widen(const Interpreter::State& state, const uint64_t bits) {
+  if (state.format == Term::BFLOAT || state.width == 32) {
+    const uint32_t single = state.format == Term::BFLOAT ? bits << 16 : bits;
+    float value;
+    std::memcpy(&value, &single, sizeof(value));
+    return value;
+  }
+  if (state.width == 16)
+    return widen_half(bits);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}
+
+// The shortest literal that encodes to 'bits', written at
+// 'out', returning its end, or 'out' if there is none.
+char* float_literal(const Interpreter::State& state, const uint64_t bits,
+  char* const out) {
+  const double value = widen(state, bits);
+  if (std::isnan(value)) {
+    if (narrow(state, std::numeric_limits<double>::quiet_NaN()) != bits)
+      return out;
+    return std::copy_n("nan", 3, out);
+  }
+  if (std::isinf(value)) {
+    if (narrow(state, value) != bits)
+      return out;
+    return std::copy_n(value > 0 ? "+inf" : "-inf", 4, out);
+  }
+  const int precision = state.format == Term::BFLOAT ? 8
+    : state.width == 16 ? 11 : state.width == 32 ? 24 : 53;
+  const int exponent_bits = state.format == Term::BFLOAT ? 8
+    : state.width == 16 ? 5 : state.width == 32 ? 8 : 11;
+  const uint64_t sign = uint64_t(1) << (precision + exponent_bits - 1);
+  const auto decimal = shortest(bits & (sign - 1), precision, exponent_bits);
+  const auto end = decimal_literal(bits & sign, decimal, out);
+  if (precision == 53 || !decimal.close)
+    return end;
+  // Narrower formats are parsed by way of doubles, and in rare
+  // cases, rounding twice takes a literal at the very edge of
+  // the interval to its neighbour. The literal for the double,
+  // which is exact, serves then.
+  *end = '\0';
+  if (narrow(state, std::strtod(out, nullptr)) == bits)
+    return end;
+  uint64_t wide;
+  std::memcpy(&wide, &value, sizeof(wide));
+  const uint64_t wide_sign = uint64_t(1) << 63;
+  return decimal_literal(wide & wide_sign,
+    shortest(wide & (wide_sign - 1), 53, 11), out);
+}
+
+namespace {
+
+// Writes 'decimal' as a float literal, which needs a decimal
+// point, in fixed notation unless its exponent is large.
+char* decimal_literal(const bool negative, Decimal decimal, char* out) {
+  if (negative)
+    *out++ = '-';
+  if (decimal.digits == 0)
+    return std::copy_n("0.0", 3, out);
+  while (decimal.digits % 10 == 0) {
+    decimal.digits /= 10;
+    ++decimal.exponent;
+  }
+  char digits[24], * const digits_end = digits + sizeof(digits);
+  const auto begin = format_unsigned(decimal.digits, digits_end);
+  const int count = digits_end - begin;
+  // The exponent of the first digit.
+  const int exponent = decimal.exponent + count - 1;
+  if (exponent >= -5 && exponent < std::numeric_limits<double>::digits10) {
+    if (exponent < 0) {
+      out = std::copy_n("0.", 2, out);
+      out = std::fill_n(out, -exponent - 1, '0');
+      return std::copy(begin, digits_end, out);
+    }
+    if (exponent >= count - 1) {
+      out = std::copy(begin, digits_end, out);
+      out = std::fill_n(out, exponent - (count - 1), '0');
+      return std::copy_n(".0", 2, out);
+    }
+    out = std::copy(begin, begin + exponent + 1, out);
+    *out++ = '.';
+    return std::copy(begin + exponent + 1, digits_end, out);
+  }
+  *out++ = *begin;
+  *out++ = '.';
+  out = count == 1 ? std::copy_n("0", 1, out)
+    : std::copy(begin + 1, digits_end, out);
+  *out++ = 'e';
+  *out++ = exponent < 0 ? '-' : '+';
+  if (std::abs(exponent) < 10)
+    *out++ = '0';
+  const auto magnitude = format_unsigned(std::abs(exponent), digits_end);
+  return std::copy(magnitude, digits_end, out);
+}
+
+// Pairs of decimal digits, so that two are converted at once.
+std::array<char, 200> digit_pair_table() {
+  std::array<char, 200> table;
+  for (int i = 0; i < 100; ++i) {
+    table[i * 2] = '0' + i / 10;
+    table[i * 2 + 1] = '0' + i % 10;
+  }
+  return table;
+}
+
+const std::array<char, 200> digit_pairs = digit_pair_table();
+
+// Writes the digits of 'value' ending at 'end', returning
+// where they begin.
+char* format_unsigned(uint64_t value, char* end) {
+  while (value >= 100) {
+    const auto pair = &digit_pairs[value % 100 * 2];
+    value /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (value >= 10) {
+    const auto pair = &digit_pairs[value * 2];
+    *--end = pair[1];
+    *--end = pair[0];
+  } else {
+    *--end = '0' + value;
+  }
+  return end;
+}
+
+// Reads one well-formed UTF-8 sequence, returning its size,
+// or 0 if there is none.
+size_t read_utf8(const uint8_t* const here, const uint8_t* const end,
+  uint32_t& rune) {
+  const uint8_t lead = *here;
+  size_t size;
+  uint32_t low = 0x80, high = 0xbf;
+  if (lead < 0x80) {
+    rune = lead;
+    return 1;
+  } else if (lead >= 0xc2 && lead <= 0xdf) {
+    size = 2;
+    rune = lead & 0x1f;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    size = 3;
+    rune = lead & 0x0f;
+    if (lead == 0xe0)
+      low = 0xa0;
+    else if (lead == 0xed)
+      high = 0x9f;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    size = 4;
+    rune = lead & 0x07;
+    if (lead == 0xf0)
+      low = 0x90;
+    else if (lead == 0xf4)
+      high = 0x8f;
+  } else {
+    return 0;
+  }
+  if (size_t(end - here) < size)
+    return 0;
+  for (size_t i = 1; i < size; ++i) {
+    const uint8_t continuation = here[i];
+    if (continuation < (i == 1 ? low : 0x80)
+      || continuation > (i == 1 ? high : 0xbf))
+      return 0;
+    rune = rune << 6 | (continuation & 0x3f);
+  }
+  return size;
+}
+
+// Reads a variable-length integer, returning its size, or 0
+// if it is cut off or too long.
+size_t read_varint(const Term::Format format, const uint8_t* const here,
+  const uint8_t* const end, uint64_t& value) {
+  const size_t available = end - here;
+  if (format == Term::PREFIX_VARINT) {
+    const size_t size = here[0] == 0 ? 9 : __builtin_ctz(here[0]) + 1;
+    if (available < size)
+      return 0;
+    value = 0;
+    if (size == 9) {
+      for (size_t i = 0; i < 8; ++i)
+        value |= uint64_t(here[i + 1]) << 8 * i;
+    } else {
+      for (size_t i = 0; i < size; ++i)
+        value |= uint64_t(here[i]) << 8 * i;
+      value >>= size;
+    }
+    return size;
+  }
+  value = 0;
+  for (size_t i = 0; i < std::min(available, max_varint_size); ++i) {
+    value |= uint64_t(here[i] & 0x7f) << 7 * i;
+    if (here[i] & 0x80)
+      continue;
+    const unsigned bits = 7 * (i + 1);
+    if (format == Term::SLEB128 && bits < 64 && here[i] & 0x40)
+      value |= ~uint64_t(0) << bits;
+    else if (format == Term::ZIGZAG)
+      value = (value >> 1) ^ -(value & 1);
+    return i + 1;
+  }
+  return 0;
+}
+
+// Runes that can be written as themselves or as an escape in
+// a string literal.
+bool is_printable(const uint32_t rune) {
+  switch (rune) {
+  case U'\a':
+  case U'\b':
+  case U'\e':
+  case U'\f':
+  case U'\n':
+  case U'\r':
+  case U'\t':
+  case U'\v':
+    return true;
+  default:
+    return rune >= 0x20 && rune != 0x7f;
+  }
+}
+
+}
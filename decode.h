@@ -0,0 +1,15 @@
+#ifndef PROTODATA_DECODE_H
+#define PROTODATA_DECODE_H
+
+#include <Interpreter.h>
+
+#include <cstdint>
+#include <iosfwd>
+
+void decode(const char*, std::istream&, const Interpreter::State&,
+  std::ostream&);
+void decode(const uint8_t*, const uint8_t*, const Interpreter::State&,
+  std::ostream&);
+char* float_literal(const Interpreter::State&, uint64_t, char*);
+
+#endif
@@ -0,0 +1,251 @@
+#include <emit.h>
+
+#include <util.h>
+#include <write.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+
+namespace {
+
+// Bits of a hole's value, 'width' of them from bit 'shift',
+// written most significant first at bit 'offset' of the
+// output, as 'Stream' writes them: each byte of a value of
+// whole bytes, in the order of its endianness, or all the
+// bits of an integer of any other width.
+struct Field {
+  uint64_t offset;
+  unsigned int width;
+  unsigned int shift;
+};
+
+std::vector<Field> fields(const Interpreter::Hole&);
+std::string field_type(const Interpreter::State&);
+std::string describe(const Interpreter::Hole&);
+std::string default_value(const Interpreter::Hole&);
+std::string range_check(const Interpreter::Hole&);
+std::string literal(uint64_t);
+std::string literal(int64_t);
+std::string literal(double);
+void deposit(const Field&, std::ostream&);
+
+}
+
+// Writes a header in which the output of a template, with
+// every hole zero, is a constant image, and each hole is
+// filled in by code specialized for it: stores of whole bytes
+// where they're aligned, and masked bits where they aren't.
+// Native endianness is that of the platform generating it.
+void emit_cpp(const std::string& name, const std::string& image,
+  const std::vector<Interpreter::Hole>& holes, std::ostream& output) {
+  std::string guard;
+  for (const char character : name)
+    guard += toupper(static_cast<unsigned char>(character));
+  guard += "_PD_H";
+  std::vector<std::string> defaults;
+  bool limits = false;
+  for (const auto& hole : holes) {
+    defaults.push_back(default_value(hole));
+    if (defaults.back().find("numeric_limits") != std::string::npos)
+      limits = true;
+  }
+  output << "// Generated by 'pd --emit-cpp " << name << "'; do not edit.\n"
+    "\n"
+    "#ifndef " << guard << "\n"
+    "#define " << guard << "\n"
+    "\n"
+    "#include <cstddef>\n"
+    "#include <cstdint>\n"
+    "#include <cstring>\n";
+  if (limits)
+    output << "#include <limits>\n";
+  output << "\n"
+    "namespace " << name << " {\n"
+    "\n"
+    "// The values of the holes, which are the defaults given in\n"
+    "// the template unless they're changed.\n"
+    "struct Holes {\n";
+  for (size_t i = 0; i < holes.size(); ++i)
+    output << "  " << field_type(holes[i].state) << ' ' << holes[i].name
+      << " = " << defaults[i] << ";\n";
+  output << "};\n"
+    "\n"
+    "const std::size_t size = " << image.size() << ";\n"
+    "\n"
+    "// Writes 'size' bytes to 'output', or returns false, writing\n"
+    "// nothing, if a value exceeds the range of its hole.\n"
+    "inline bool encode(const Holes&" << (holes.empty() ? "" : " holes")
+    << ", std::uint8_t* const output) {\n";
+  for (const auto& hole : holes) {
+    const auto check = range_check(hole);
+    if (!check.empty())
+      output << "  if (" << check << ")\n"
+        "    return false;\n";
+  }
+  output << "  static constexpr std::uint8_t image["
+    << std::max<size_t>(image.size(), 1) << "] = {";
+  for (size_t i = 0; i < image.size(); ++i)
+    output << (i % 12 ? " " : "\n    ") << "0x" << std::hex
+      << std::setw(2) << std::setfill('0')
+      << unsigned(static_cast<unsigned char>(image[i])) << std::dec << ',';
+  output << "\n  };\n"
+    "  std::memcpy(output, image, size);\n";
+  for (const auto& hole : holes) {
+    output << "  {\n"
+      "    // " << describe(hole) << "\n";
+    if (hole.state.format == Term::INTEGER)
+      output << "    const std::uint64_t value = std::uint64_t(holes."
+        << hole.name << ");\n";
+    else if (hole.state.width == 32)
+      output << "    std::uint32_t bits;\n"
+        "    std::memcpy(&bits, &holes." << hole.name << ", sizeof bits);\n"
+        "    const std::uint64_t value = bits;\n";
+    else
+      output << "    std::uint64_t value;\n"
+        "    std::memcpy(&value, &holes." << hole.name
+        << ", sizeof value);\n";
+    for (const auto& field : fields(hole))
+      deposit(field, output);
+    output << "  }\n";
+  }
+  output << "  return true;\n"
+    "}\n"
+    "\n"
+    "}\n"
+    "\n"
+    "#endif\n";
+}
+
+namespace {
+
+Term::Endianness resolved(const Term::Endianness endianness) {
+  return endianness == Term::NATIVE ? platform_endianness() : endianness;
+}
+
+bool whole_bytes(const Interpreter::State& state) {
+  return state.width == 8 || state.width == 16 || state.width == 32
+    || state.width == 64;
+}
+
+std::vector<Field> fields(const Interpreter::Hole& hole) {
+  const auto& state = hole.state;
+  if (!whole_bytes(state)) {
+    const Field field = { hole.offset, state.width, 0 };
+    return std::vector<Field>(1, field);
+  }
+  const bool big = resolved(state.endianness) == Term::BIG;
+  const unsigned int size = state.width / 8;
+  std::vector<Field> result;
+  for (unsigned int i = 0; i < size; ++i) {
+    const Field field
+      = { hole.offset + i * 8, 8, (big ? size - 1 - i : i) * 8 };
+    result.push_back(field);
+  }
+  return result;
+}
+
+std::string field_type(const Interpreter::State& state) {
+  if (state.format == Term::FLOAT)
+    return state.width == 32 ? "float" : "double";
+  const unsigned int width = state.width <= 8 ? 8 : state.width <= 16 ? 16
+    : state.width <= 32 ? 32 : 64;
+  return join(state.signedness == Term::SIGNED ? "std::int" : "std::uint",
+    width, "_t");
+}
+
+std::string describe(const Interpreter::Hole& hole) {
+  const auto& state = hole.state;
+  const char* const order = !whole_bytes(state) || state.width == 8 ? ""
+    : resolved(state.endianness) == Term::BIG ? "big " : "little ";
+  const char* const format = state.format == Term::FLOAT ? "f"
+    : state.signedness == Term::SIGNED ? "i" : "u";
+  return join(hole.name, ": ", order, format, state.width, " at ",
+    hole.offset % 8 ? join("bit ", hole.offset)
+      : join("byte ", hole.offset / 8));
+}
+
+std::string default_value(const Interpreter::Hole& hole) {
+  switch (hole.type) {
+  case Term::WRITE_SIGNED:
+    return literal(hole.value.as_signed);
+  case Term::WRITE_UNSIGNED:
+    return literal(hole.value.as_unsigned);
+  default:
+    return literal(hole.value.as_double);
+  }
+}
+
+// Only integers narrower than their type can be out of range.
+std::string range_check(const Interpreter::Hole& hole) {
+  const auto& state = hole.state;
+  if (state.format != Term::INTEGER || whole_bytes(state))
+    return std::string();
+  const auto value = join("holes.", hole.name);
+  if (state.signedness == Term::UNSIGNED)
+    return join(value, " > ", literal((uint64_t(1) << state.width) - 1));
+  const int64_t limit = int64_t(1) << (state.width - 1);
+  return join(value, " < ", literal(-limit), " || ", value, " > ",
+    literal(limit - 1));
+}
+
+std::string literal(const uint64_t value) {
+  if (value <= uint64_t(std::numeric_limits<int>::max()))
+    return join(value);
+  return join(value, value <= std::numeric_limits<uint32_t>::max()
+    ? "u" : "ull");
+}
+
+std::string literal(const int64_t value) {
+  if (value == std::numeric_limits<int64_t>::min())
+    return join("(", value + 1, "ll - 1)");
+  if (value >= std::numeric_limits<int>::min()
+    && value <= std::numeric_limits<int>::max())
+    return join(value);
+  return join(value, "ll");
+}
+
+std::string literal(const double value) {
+  if (std::isnan(value))
+    return "std::numeric_limits<double>::quiet_NaN()";
+  if (std::isinf(value))
+    return join(value < 0 ? "-" : "",
+      "std::numeric_limits<double>::infinity()");
+  std::ostringstream result;
+  result << std::setprecision(std::numeric_limits<double>::max_digits10)
+    << value;
+  auto text = result.str();
+  if (text.find_first_of(".e") == std::string::npos)
+    text += ".0";
+  return text;
+}
+
+// Each byte that a field covers is stored whole, if it can
+// be, or has the field's bits in it set.
+void deposit(const Field& field, std::ostream& output) {
+  const uint64_t end = field.offset + field.width;
+  for (uint64_t byte = field.offset / 8; byte * 8 < end; ++byte) {
+    const uint64_t low = std::max(field.offset, byte * 8),
+      high = std::min(end, byte * 8 + 8);
+    const unsigned int shift = field.shift + (end - high);
+    std::string bits = shift ? join("value >> ", shift) : "value";
+    if (high - low == 8) {
+      output << "    output[" << byte << "] = std::uint8_t(" << bits
+        << ");\n";
+      continue;
+    }
+    if (shift)
+      bits = join("(", bits, ")");
+    bits = join(bits, " & ", (1u << (high - low)) - 1);
+    if (high != byte * 8 + 8)
+      bits = join("(", bits, ") << ", byte * 8 + 8 - high);
+    output << "    output[" << byte << "] |= std::uint8_t(" << bits
+      << ");\n";
+  }
+}
+
+}
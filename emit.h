@@ -0,0 +1,13 @@
+#ifndef PROTODATA_EMIT_H
+#define PROTODATA_EMIT_H
+
+#include <Interpreter.h>
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+void emit_cpp(const std::string&, const std::string&,
+  const std::vector<Interpreter::Hole>&, std::ostream&);
+
+#endif
@@ -0,0 +1,286 @@
+#include <generate.h>
+
+#include <Stats.h>
+#include <Stream.h>
+#include <write.h>
+
+#include <array>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Values are generated and encoded this many at a time.
+const size_t block_size = 512;
+
+template<class T>
+void write_block(const std::array<uint64_t, block_size>&, size_t,
+  Term::Endianness, Stream&);
+
+template<class T>
+T byte_swap(T);
+
+bool is_bulk_integer(const Interpreter::State&);
+void write_integer_block(const Interpreter::State&,
+  const std::array<uint64_t, block_size>&, size_t, Stream&);
+bool fits(const Interpreter::State&, const Term::Sequence&);
+void write_sequence_value(const Interpreter::State&, Interpreter::Base&,
+  const Term::Sequence&, uint64_t, Stream&);
+
+}
+
+// The value at 'index' of the SplitMix64 sequence seeded with
+// 'seed'. Each value depends only on its seed and index, so
+// output is the same on every machine however it is divided.
+uint64_t random_value(const uint64_t seed, const uint64_t index) {
+  uint64_t value = seed + (index + 1) * 0x9e3779b97f4a7c15ull;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+// Integers are uniform over the whole range of the current
+// type, taken from the high bits of each random value, and
+// floats are uniform in [0, 1) at the current precision.
+// Byte-sized integers and f32/f64 are encoded a block at a
+// time; everything else goes through the usual writers.
+void write_random(const Interpreter::State& state, Interpreter::Base& base,
+  const uint64_t seed, const uint64_t count, Stream& output) {
+  if (state.format == Term::UNICODE)
+    throw std::runtime_error
+      ("Random values cannot be written in Unicode format.");
+  STATS(values[state.format][state.width] += count);
+  const bool integer = state.format == Term::INTEGER && !is_relative(state);
+  const bool floating = state.format == Term::FLOAT && state.width != 16;
+  // Every value has the same size, and none can be out of range.
+  if (output.counting()
+    && (integer || state.format == Term::FLOAT
+      || state.format == Term::BFLOAT)) {
+    output.count(count * state.width);
+    return;
+  }
+  std::array<uint64_t, block_size> block;
+  for (uint64_t start = 0; start < count; start += block_size) {
+    const auto size = std::min<uint64_t>(block_size, count - start);
+    for (size_t i = 0; i < size; ++i)
+      block[i] = random_value(seed, start + i);
+    if (integer && is_bulk_integer(state)) {
+      for (size_t i = 0; i < size; ++i)
+        block[i] >>= 64 - state.width;
+      write_integer_block(state, block, size, output);
+    } else if (integer) {
+      for (size_t i = 0; i < size; ++i)
+        output.write(block[i] >> (64 - state.width), state.width);
+    } else if (floating && state.width == 32) {
+      for (size_t i = 0; i < size; ++i) {
+        const float value = (block[i] >> 40) / float(1 << 24);
+        std::memcpy(&block[i], &value, sizeof(value));
+      }
+      write_block<uint32_t>(block, size, state.endianness, output);
+    } else if (floating) {
+      for (size_t i = 0; i < size; ++i) {
+        const double value = (block[i] >> 11) / double(uint64_t(1) << 53);
+        std::memcpy(&block[i], &value, sizeof(value));
+      }
+      write_block<uint64_t>(block, size, state.endianness, output);
+    } else if (state.format == Term::FLOAT) {
+      for (size_t i = 0; i < size; ++i)
+        write_float(state, (block[i] >> 53) / double(1 << 11), output);
+    } else if (state.format == Term::BFLOAT) {
+      for (size_t i = 0; i < size; ++i)
+        write_float(state, (block[i] >> 56) / double(1 << 8), output);
+    } else if (is_signed(state)) {
+      const auto shift = state.format == Term::INTEGER
+        ? 64 - state.width : 0;
+      for (size_t i = 0; i < size; ++i)
+        write_relative_integer
+          (state, base, Term::Signed(block[i]) >> shift, output);
+    } else {
+      const auto shift = state.format == Term::INTEGER
+        ? 64 - state.width : 0;
+      for (size_t i = 0; i < size; ++i)
+        write_relative_integer(state, base, block[i] >> shift, output);
+    }
+  }
+}
+
+// Writes each combination of values from the sequences, the
+// last varying fastest. A single integer sequence of a byte-
+// sized type is generated a block at a time as 'start + i *
+// step'. Sequences that may not fit the type are written one
+// value at a time, so that errors occur at the right value.
+void write_sequences(const Interpreter::State& state,
+  Interpreter::Base& base, const Term::Sequence* const sequences,
+  const size_t size, Stream& output) {
+  const auto limit = std::numeric_limits<uint64_t>::max();
+  uint64_t total = size;
+  for (size_t i = 0; i < size; ++i) {
+    if (total && sequences[i].count > limit / total)
+      throw std::runtime_error
+        ("Number of values in sequences exceeds range of 64-bit integer.");
+    total *= sequences[i].count;
+  }
+  if (total == 0)
+    return;
+  // Checked whether or not the output is counted, so that
+  // '--check' reports the same errors.
+  if (total > limit / state.width)
+    throw std::runtime_error
+      ("Size of sequences in bits exceeds range of 64-bit integer.");
+  STATS(values[state.format][state.width] += total);
+  bool bulk = state.format == Term::INTEGER && !is_relative(state);
+  for (size_t i = 0; i < size; ++i)
+    bulk = bulk && fits(state, sequences[i]);
+  if (output.counting() && bulk) {
+    output.count(total * state.width);
+    return;
+  }
+  bulk = bulk && is_bulk_integer(state);
+  std::array<uint64_t, block_size> block;
+  if (bulk && size == 1) {
+    const auto& sequence = sequences[0];
+    for (uint64_t start = 0; start < sequence.count; start += block_size) {
+      const auto count
+        = std::min<uint64_t>(block_size, sequence.count - start);
+      const auto first = sequence.start.as_unsigned
+        + start * sequence.step.as_unsigned;
+      for (size_t i = 0; i < count; ++i)
+        block[i] = first + i * sequence.step.as_unsigned;
+      write_integer_block(state, block, count, output);
+    }
+    return;
+  }
+  std::vector<uint64_t> indices(size);
+  size_t filled = 0;
+  while (true) {
+    for (size_t i = 0; i < size; ++i) {
+      if (!bulk) {
+        write_sequence_value
+          (state, base, sequences[i], indices[i], output);
+        continue;
+      }
+      block[filled++] = sequences[i].start.as_unsigned
+        + indices[i] * sequences[i].step.as_unsigned;
+      if (filled == block.size()) {
+        write_integer_block(state, block, filled, output);
+        filled = 0;
+      }
+    }
+    auto dimension = size;
+    while (dimension > 0
+      && ++indices[dimension - 1] == sequences[dimension - 1].count)
+      indices[--dimension] = 0;
+    if (dimension == 0)
+      break;
+  }
+  if (filled != 0)
+    write_integer_block(state, block, filled, output);
+}
+
+namespace {
+
+// Plain integers of 8, 16, 32, or 64 bits.
+bool is_bulk_integer(const Interpreter::State& state) {
+  return state.format == Term::INTEGER && !is_relative(state)
+    && state.width % 8 == 0 && (state.width & (state.width - 1)) == 0;
+}
+
+void write_integer_block(const Interpreter::State& state,
+  const std::array<uint64_t, block_size>& block, const size_t size,
+  Stream& output) {
+  switch (state.width) {
+  case 8:
+    write_block<uint8_t>(block, size, state.endianness, output);
+    break;
+  case 16:
+    write_block<uint16_t>(block, size, state.endianness, output);
+    break;
+  case 32:
+    write_block<uint32_t>(block, size, state.endianness, output);
+    break;
+  case 64:
+    write_block<uint64_t>(block, size, state.endianness, output);
+    break;
+  }
+}
+
+// Whether every value of an integer sequence fits the current
+// integer type. Sequences are monotonic, so it's enough to
+// check the first and last values.
+bool fits(const Interpreter::State& state, const Term::Sequence& sequence) {
+  if (sequence.type == Term::WRITE_DOUBLE)
+    return false;
+  const auto first = sequence.start.as_unsigned,
+    last = first + (sequence.count - 1) * sequence.step.as_unsigned;
+  const bool is_signed = sequence.type == Term::WRITE_SIGNED;
+  const uint64_t maximum = state.signedness == Term::SIGNED
+    ? (uint64_t(1) << (state.width - 1)) - 1
+    : std::numeric_limits<uint64_t>::max() >> (64 - state.width);
+  for (const auto value : { first, last }) {
+    if (!is_signed || int64_t(value) >= 0) {
+      if (value > maximum)
+        return false;
+    } else if (state.signedness == Term::UNSIGNED
+      || 0 - value > maximum + 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void write_sequence_value(const Interpreter::State& state,
+  Interpreter::Base& base, const Term::Sequence& sequence,
+  const uint64_t index, Stream& output) {
+  switch (sequence.type) {
+  case Term::WRITE_SIGNED:
+    write_relative_integer(state, base, Term::Signed
+      (sequence.start.as_unsigned + index * sequence.step.as_unsigned),
+      output);
+    break;
+  case Term::WRITE_UNSIGNED:
+    write_relative_integer(state, base,
+      sequence.start.as_unsigned + index * sequence.step.as_unsigned,
+      output);
+    break;
+  default:
+    write_float(state,
+      sequence.start.as_double + index * sequence.step.as_double, output);
+  }
+}
+
+template<class T>
+void write_block(const std::array<uint64_t, block_size>& block,
+  const size_t size, const Term::Endianness endianness, Stream& output) {
+  const bool swap = endianness != Term::NATIVE
+    && endianness != platform_endianness();
+  std::array<uint8_t, block_size * sizeof(uint64_t)> bytes;
+  for (size_t i = 0; i < size; ++i) {
+    const T value(swap ? byte_swap(T(block[i])) : T(block[i]));
+    std::memcpy(&bytes[i * sizeof(T)], &value, sizeof(T));
+  }
+  const uint8_t* const data = bytes.data();
+  output.write(data, data + size * sizeof(T));
+}
+
+template<>
+uint8_t byte_swap(const uint8_t value) {
+  return value;
+}
+
+template<>
+uint16_t byte_swap(const uint16_t value) {
+  return __builtin_bswap16(value);
+}
+
+template<>
+uint32_t byte_swap(const uint32_t value) {
+  return __builtin_bswap32(value);
+}
+
+template<>
+uint64_t byte_swap(const uint64_t value) {
+  return __builtin_bswap64(value);
+}
+
+}
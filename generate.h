@@ -0,0 +1,16 @@
+#ifndef PROTODATA_GENERATE_H
+#define PROTODATA_GENERATE_H
+
+#include <Interpreter.h>
+
+#include <cstdint>
+
+class Stream;
+
+uint64_t random_value(uint64_t, uint64_t);
+void write_random(const Interpreter::State&, Interpreter::Base&, uint64_t,
+  uint64_t, Stream&);
+void write_sequences(const Interpreter::State&, Interpreter::Base&,
+  const Term::Sequence*, size_t, Stream&);
+
+#endif
@@ -1,5 +1,12 @@
+#include <Columns.h>
+#include <ComparingStream.h>
 #include <Interpreter.h>
+#include <Stats.h>
+#include <Stream.h>
 #include <arguments.h>
+#include <cache.h>
+#include <decode.h>
+#include <emit.h>
 #include <parse.h>
 
 #include <nested_exception.h>
@@ -8,21 +15,107 @@
 #include <utf8.h>
 
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 
 void report(const std::exception&, int = 0);
 
 int main(int argc, char** argv) try {
   using namespace std;
-  auto parsed_arguments = parse_arguments(argc, argv);
-  const auto inputs = move(get<0>(parsed_arguments));
-  const auto output = move(get<1>(parsed_arguments));
-  vector<Term> terms;
-  Interpreter interpreter(*output);
-  for (const auto& input : inputs) try {
-    parse(*input.stream, interpreter);
-  } catch (...) {
-    ::throw_with_nested(runtime_error(join("In input ", input.name, ":")));
+  auto arguments = parse_arguments(argc, argv);
+  const auto& output = arguments.output;
+  unique_ptr<Stats> statistics;
+  if (arguments.report != NO_REPORT) {
+    statistics.reset(new Stats(arguments.counters));
+    stats = statistics.get();
+  }
+  if (arguments.action == DECODE) {
+    const auto state = parse_state(arguments.decode);
+    for (const auto& input : arguments.inputs) try {
+      decode(input.file ? input.name : nullptr, *input.stream, state,
+        *output);
+    } catch (const different_output&) {
+      throw;
+    } catch (...) {
+      ::throw_with_nested(runtime_error(join("In input ", input.name, ":")));
+    }
+    return 0;
+  }
+  unique_ptr<Interpreter> interpreter;
+  unique_ptr<Stream> stream;
+  // A template's output is generated code, and what it
+  // compiles to is only its image.
+  const bool emitting = arguments.action == EMIT_CPP;
+  ostringstream image;
+  vector<Interpreter::Hole> holes;
+  if (!arguments.columns.empty()) {
+    stream.reset(output ? new Stream(*output) : new Stream());
+    Columns columns(arguments.columns, arguments.delimiter, arguments.align,
+      *stream);
+    if (arguments.transpose)
+      columns.transpose(arguments.transpose, arguments.transpose_memory);
+    for (const auto& input : arguments.inputs) try {
+      columns.import(*input.stream);
+    } catch (const different_output&) {
+      throw;
+    } catch (...) {
+      ::throw_with_nested(runtime_error(join("In input ", input.name, ":")));
+    }
+    columns.finish();
+  } else {
+    interpreter.reset(emitting ? new Interpreter(image)
+      : output ? new Interpreter(*output) : new Interpreter());
+    if (emitting)
+      interpreter->collect_holes(&holes);
+    for (const auto& section : arguments.sections)
+      interpreter->add_section(section.name, section.output.get());
+    for (const auto& input : arguments.inputs) try {
+      if (output && !emitting && !arguments.cache.empty())
+        parse_cached(*input.stream, *interpreter, arguments.cache,
+          arguments.optimize);
+      else
+        parse(*input.stream, *interpreter, arguments.optimize);
+    } catch (const different_output&) {
+      throw;
+    } catch (...) {
+      ::throw_with_nested(runtime_error(join("In input ", input.name, ":")));
+    }
+  }
+  if (arguments.action == SIZE) {
+    cout << (stream ? stream->size() : interpreter->size()) << '\n';
+    if (interpreter)
+      for (const auto& section : arguments.sections)
+        cout << section.name << ' ' << interpreter->size(section.name)
+          << '\n';
+  }
+  if (interpreter) {
+    STATS_PHASE(WRITE);
+    interpreter->finish();
+  }
+  if (emitting)
+    emit_cpp(arguments.emit, image.str(), holes, *output);
+  // Output compared with existing files is complete once its
+  // streams are destroyed, and only then can it be finished.
+  if (!arguments.compared.empty()) {
+    STATS_PHASE(WRITE);
+    interpreter.reset();
+    stream.reset();
+    arguments.output.reset();
+    arguments.sections.clear();
+    for (const auto& compared : arguments.compared)
+      compared->finish();
+  }
+  if (statistics) {
+    // Count the final flush of the output.
+    {
+      STATS_PHASE(WRITE);
+      interpreter.reset();
+      stream.reset();
+      if (output)
+        output->flush();
+    }
+    statistics->report(cerr, arguments.report == JSON_REPORT);
   }
 } catch (const std::exception& exception) {
   report(exception);
@@ -1,6 +1,10 @@
 #include <parse.h>
 
+#include <ComparingStream.h>
 #include <Interpreter.h>
+#include <Optimizer.h>
+#include <SourceReader.h>
+#include <Stats.h>
 #include <Term.h>
 #include <chartype.h>
 #include <nested_exception.h>
@@ -8,8 +12,13 @@
 
 #include <utf8.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <limits>
 #include <map>
+#include <set>
+#include <sstream>
 #include <string>
 
 namespace {
@@ -19,21 +28,81 @@ typedef std::numeric_limits<double> double_limits;
 typedef std::vector<Term> Terms;
 typedef std::pair<std::string, Terms> Command;
 const std::map<std::string, Terms> commands {
+  Command("f16",     Terms { Term::FLOAT, Term::Width(16) }),
+  Command("bf16",    Terms { Term::BFLOAT, Term::Width(16) }),
   Command("f32",     Terms { Term::FLOAT, Term::Width(32) }),
   Command("f64",     Terms { Term::FLOAT, Term::Width(64) }),
   Command("utf8",    Terms { Term::UNICODE, Term::Width(8)  }),
   Command("utf16",   Terms { Term::UNICODE, Term::Width(16) }),
   Command("utf32",   Terms { Term::INTEGER, Term::Width(32) }),
   Command("ucs2",    Terms { Term::INTEGER, Term::Width(16) }),
+  Command("uleb128", Terms { Term::ULEB128 }),
+  Command("sleb128", Terms { Term::SLEB128 }),
+  Command("zigzag",  Terms { Term::ZIGZAG }),
+  Command("prefix_varint", Terms { Term::PREFIX_VARINT }),
   Command("native",  Terms { Term::NATIVE }),
   Command("little",  Terms { Term::LITTLE }),
   Command("big",     Terms { Term::BIG }),
+  Command("absolute", Terms { Term::ABSOLUTE }),
+  Command("delta",   Terms { Term::DELTA }),
+  Command("for",     Terms { Term::FRAME }),
+  Command("crc32",   Terms { Term::checksum(Term::CRC32, Term::AFTER) }),
+  Command("crc32c",  Terms { Term::checksum(Term::CRC32C, Term::AFTER) }),
+  Command("adler32", Terms { Term::checksum(Term::ADLER32, Term::AFTER) }),
+  Command("xxh32",   Terms { Term::checksum(Term::XXH32, Term::AFTER) }),
+  Command("xxh64",   Terms { Term::checksum(Term::XXH64, Term::AFTER) }),
+  Command("crc32_before",
+    Terms { Term::checksum(Term::CRC32, Term::BEFORE) }),
+  Command("crc32c_before",
+    Terms { Term::checksum(Term::CRC32C, Term::BEFORE) }),
+  Command("adler32_before",
+    Terms { Term::checksum(Term::ADLER32, Term::BEFORE) }),
+  Command("xxh32_before",
+    Terms { Term::checksum(Term::XXH32, Term::BEFORE) }),
+  Command("xxh64_before",
+    Terms { Term::checksum(Term::XXH64, Term::BEFORE) }),
   Command("epsilon", Terms { Term::write(double_limits::epsilon()) }),
   Command("nan",     Terms { Term::write(double_limits::quiet_NaN()) }),
   Command("+inf",    Terms { Term::write(double_limits::infinity()) }),
   Command("-inf",    Terms { Term::write(-double_limits::infinity()) }),
 };
 
+// A function argument is either a string, with escapes
+// already resolved, or a numeric literal as written.
+struct Argument {
+  Argument(const std::string& text, const bool quoted)
+    : text(text), quoted(quoted) {}
+  std::string text;
+  bool quoted;
+};
+
+typedef std::vector<Argument> Arguments;
+
+// A function call, holding anything that the terms it
+// produces refer to until the next call.
+struct Call {
+  Arguments arguments;
+  std::vector<Term::Sequence> sequences;
+};
+
+typedef void function_type(Call&, Terms&);
+typedef std::pair<std::string, function_type*> Function;
+
+function_type at, grid, here, hole, include_bytes, random, range,
+  section, size_of;
+
+const std::map<std::string, function_type*> functions {
+  Function("at", at),
+  Function("grid", grid),
+  Function("here", here),
+  Function("hole", hole),
+  Function("include_bytes", include_bytes),
+  Function("random", random),
+  Function("range", range),
+  Function("section", section),
+  Function("size_of", size_of),
+};
+
 template<class I, class O>
 bool accept(uint32_t, I&, I, O);
 
@@ -46,6 +115,9 @@ bool accept_if(P, I&, I, O);
 template<class P, class I>
 bool accept_if(P, I&, I);
 
+template<class I, class O>
+bool accept_exponent(I&, I, O);
+
 template<class T, class... Args>
 bool transition(T&, const T&, Args&&...);
 
@@ -65,55 +137,94 @@ enum State {
   DECIMAL,
   HEXADECIMAL,
   FLOAT,
+  EXPONENT,
   STRING,
   ESCAPE,
+  HEX_BLOB,
+  BASE64_BLOB,
+  ARGUMENTS,
+  ARGUMENT_STRING,
+  ARGUMENT_ESCAPE,
+};
+
+// Decoding state carried across lines of a blob literal.
+struct Blob {
+  Blob() : bits(0), count(0), padding(0) {}
+  uint32_t bits;
+  unsigned int count;
+  unsigned int padding;
 };
 
-Term write_double_term(const std::string&);
-Term write_integer_term(const std::string&, int);
+typedef std::vector<uint32_t>::const_iterator Runes;
+typedef Runes decode_function(Runes, Runes, Blob&, std::vector<uint8_t>&);
+decode_function decode_hex, decode_base64;
+typedef void finish_function(Blob&, std::vector<uint8_t>&);
+finish_function finish_hex, finish_base64;
+
 unsigned long parse_width(const std::string&);
+uint32_t escape_value(uint32_t);
+Arguments split_arguments(const std::string&);
 
 }
 
 void parse_internal
-  (std::istream&, Interpreter&, unsigned int&, unsigned int&);
+  (std::istream&, Optimizer&, unsigned int&, unsigned int&);
 
-void parse(std::istream& input, Interpreter& interpreter) {
+// Terms are optimized before they are run, unless 'optimize'
+// is false.
+void parse(std::istream& input, Interpreter& interpreter,
+  const bool optimize) {
+  // Errors reading the first line, such as compressed input
+  // that is corrupt, are reported at its start.
   unsigned int line = 1;
-  unsigned int column = 0;
+  unsigned int column = 1;
+  Optimizer optimizer(interpreter, optimize);
   try {
-    parse_internal(input, interpreter, line, column);
+    parse_internal(input, optimizer, line, column);
+    optimizer.flush();
+  } catch (const different_output&) {
+    throw;
   } catch (...) {
+    // Output before the error is written all the same.
+    try {
+      optimizer.flush();
+    } catch (...) {}
     ::throw_with_nested(std::runtime_error
       (join("At line ", line, ", column ", column, ":")));
   }
 }
 
-void parse_internal(std::istream& input, Interpreter& interpreter,
+void parse_internal(std::istream& input, Optimizer& optimizer,
   unsigned int& line, unsigned int& column) {
+  STATS_PHASE(LEX);
   State state = NORMAL;
   std::vector<Term> terms;
   std::string token;
   auto append = std::back_inserter(token);
-  std::vector<uint32_t> runes;
-  auto here = runes.begin(), end = runes.end();
-  while (true) {
-    if (here == end) {
-      std::string buffer;
-      std::getline(input, buffer);
-      runes.clear();
-      utf8::utf8to32(buffer.begin(), buffer.end(), std::back_inserter(runes));
-      if (!input.eof()) {
-        runes.push_back(U'\n');
-        ++line;
-      }
-      here = runes.begin();
-      end = runes.end();
+  std::vector<uint8_t> octets;
+  Blob blob;
+  function_type* function = nullptr;
+  Call call;
+  SourceReader source(input);
+  Runes line_begin, here, end;
+  const auto next_line = [&] {
+    const bool valid = source.next(here, end);
+    line = source.line();
+    line_begin = here;
+    if (!valid) {
+      column = end - here;
+      throw std::runtime_error(join("Invalid UTF-8 at byte ",
+        source.invalid_offset(), "."));
     }
+  };
+  next_line();
+  while (true) {
+    if (here == end)
+      next_line();
     switch (state) {
     case NORMAL:
       token.clear();
-      column = here - runes.begin();
+      column = here - line_begin;
       if (accept_if(is_whitespace, here, end)
         || transition(state, STRING, U'"', here, end)
         || transition(state, UNSIGNED, U'u', here, end, append)
@@ -123,12 +234,15 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
         || transition(state, NUMBER, U'+', here, end, append)
         || transition(state, NUMBER, U'-', here, end, append))
         break;
-      if (accept(U'{', here, end))
+      if (accept(U'{', here, end)) {
+        STATS(tokens[Stats::BRACE]++);
         terms.push_back(Term::push());
-      else if (accept(U'}', here, end))
+      } else if (accept(U'}', here, end)) {
+        STATS(tokens[Stats::BRACE]++);
         terms.push_back(Term::pop());
-      else
+      } else {
         state = NUMBER;
+      }
       break;
     case NUMBER:
       if (transition(state, ZERO, U'0', here, end, append)
@@ -144,20 +258,41 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
         throw std::runtime_error(message);
       }
     case COMMENT:
-      if (transition(state, NORMAL, U'\n', here, end))
+      if (transition(state, NORMAL, U'\n', here, end)) {
+        STATS(tokens[Stats::COMMENT]++);
         break;
+      }
       if (here == end)
         return;
       ++here;
       break;
     case IDENTIFIER:
-      if (accept_if(is_alphanumeric, here, end, append))
+      if (accept_if(is_alphanumeric, here, end, append)
+        || accept(U'_', here, end, append))
+        break;
+      if ((token == "x" && transition(state, HEX_BLOB, U'"', here, end))
+        || (token == "b64"
+          && transition(state, BASE64_BLOB, U'"', here, end))) {
+        STATS(tokens[Stats::BLOB]++);
+        blob = Blob();
+        break;
+      }
+      if (transition(state, ARGUMENTS, U'(', here, end)) {
+        STATS(tokens[Stats::FUNCTION]++);
+        const auto found = functions.find(token);
+        if (found == functions.end())
+          throw std::runtime_error(join
+            ("Unimplemented function: '", token, "'."));
+        function = found->second;
+        token.clear();
         break;
+      }
       {
         const auto command = commands.find(token);
         if (command == commands.end())
           throw std::runtime_error(join
             ("Unimplemented command: '", token, "'.\n"));
+        STATS(tokens[Stats::COMMAND]++);
         terms.insert(terms.end(),
           command->second.begin(), command->second.end());
       }
@@ -170,6 +305,7 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
         break;
       {
         const auto width = parse_width(token);
+        STATS(tokens[Stats::TYPE]++);
         terms.push_back(Term::INTEGER);
         terms.push_back(Term::UNSIGNED);
         terms.push_back(Term::Width(width));
@@ -183,6 +319,7 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
         break;
       {
         const auto width = parse_width(token);
+        STATS(tokens[Stats::TYPE]++);
         terms.push_back(Term::INTEGER);
         terms.push_back(Term::SIGNED);
         terms.push_back(Term::Width(width));
@@ -227,6 +364,17 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
       state = NORMAL;
       break;
     case FLOAT:
+      if (accept_if(is_decimal, here, end, append)
+        || accept(U'_', here, end))
+        break;
+      if (accept_exponent(here, end, append)) {
+        state = EXPONENT;
+        break;
+      }
+      terms.push_back(write_double_term(token));
+      state = NORMAL;
+      break;
+    case EXPONENT:
       if (accept_if(is_decimal, here, end, append)
         || accept(U'_', here, end))
         break;
@@ -234,48 +382,93 @@ void parse_internal(std::istream& input, Interpreter& interpreter,
       state = NORMAL;
       break;
     case STRING:
-      if (transition(state, NORMAL, U'"', here, end)
-        || transition(state, ESCAPE, U'\\', here, end))
+      if (transition(state, NORMAL, U'"', here, end)) {
+        STATS(tokens[Stats::STRING]++);
+        break;
+      }
+      if (transition(state, ESCAPE, U'\\', here, end))
         break;
       if (here == end)
         throw std::runtime_error("Unexpected end of file in string.");
       terms.push_back(Term::write(Term::Unsigned(*here++)));
       break;
     case ESCAPE:
+      terms.push_back(Term::write(Term::Unsigned(escape_value(*here))));
+      ++here;
+      state = STRING;
+      break;
+    case ARGUMENTS:
+      if (accept(U')', here, end)) {
+        call = Call();
+        call.arguments = split_arguments(token);
+        function(call, terms);
+        state = NORMAL;
+        break;
+      }
+      if (transition(state, ARGUMENT_STRING, U'"', here, end, append))
+        break;
+      if (here == end)
+        throw std::runtime_error("Unexpected end of file in arguments.");
+      utf8::append(*here++, append);
+      break;
+    case ARGUMENT_STRING:
+      if (transition(state, ARGUMENTS, U'"', here, end, append)
+        || transition(state, ARGUMENT_ESCAPE, U'\\', here, end, append))
+        break;
+      if (here == end)
+        throw std::runtime_error("Unexpected end of file in string.");
+      utf8::append(*here++, append);
+      break;
+    case ARGUMENT_ESCAPE:
+      if (here == end)
+        throw std::runtime_error("Unexpected end of file in string.");
+      utf8::append(*here++, append);
+      state = ARGUMENT_STRING;
+      break;
+    case HEX_BLOB:
+    case BASE64_BLOB:
+      // Everything up to the closing quote or the end of the
+      // line is decoded at once and written as one term.
       {
-        Term::Unsigned value = 0;
-        switch (*here) {
-        case U'"': value = U'"'; break;
-        case U'a': value = U'\a'; break;
-        case U'b': value = U'\b'; break;
-        case U'e': value = U'\e'; break;
-        case U'f': value = U'\f'; break;
-        case U'n': value = U'\n'; break;
-        case U'r': value = U'\r'; break;
-        case U't': value = U'\t'; break;
-        case U'v': value = U'\v'; break;
-        case U'\\': value = U'\\'; break;
-        default:
-          {
-            std::string message("Invalid escape character: '");
-            utf8::append(*here, std::back_inserter(message));
-            message += "'.";
-            throw std::runtime_error(message);
-          }
+        if (here == end)
+          throw std::runtime_error("Unexpected end of file in blob.");
+        STATS_PHASE(LITERAL);
+        const bool hex = state == HEX_BLOB;
+        const Runes quote = std::find(here, end, U'"');
+        octets.clear();
+        const auto invalid
+          = (hex ? decode_hex : decode_base64)(here, quote, blob, octets);
+        if (invalid != quote) {
+          column = invalid - line_begin;
+          std::string message(hex
+            ? "Invalid hexadecimal digit in blob: '"
+            : "Invalid base64 character in blob: '");
+          utf8::append(*invalid, std::back_inserter(message));
+          message += "'.";
+          throw std::runtime_error(message);
         }
-        terms.push_back(Term::write(value));
-        ++here;
-        state = STRING;
+        here = quote;
+        if (here != end) {
+          column = here - line_begin;
+          (hex ? finish_hex : finish_base64)(blob, octets);
+          ++here;
+          state = NORMAL;
+        }
+        if (!octets.empty())
+          terms.push_back(Term::write(&octets[0], octets.size()));
       }
+      break;
+    }
+    if (!terms.empty()) {
+      optimizer.run(terms);
+      terms.clear();
     }
-    interpreter.run(terms);
-    terms.clear();
   }
 }
 
-namespace {
-
 Term write_double_term(const std::string& token) {
+  STATS_PHASE(LITERAL);
+  STATS(tokens[Stats::FLOAT]++);
   char* boundary;
   const auto value = std::strtod(token.c_str(), &boundary);
   if (boundary != token.c_str() + token.size())
@@ -285,6 +478,8 @@ Term write_double_term(const std::string& token) {
 }
 
 Term write_integer_term(const std::string& token, int base) {
+  STATS_PHASE(LITERAL);
+  STATS(tokens[Stats::INTEGER]++);
   const bool has_sign = token[0] == '-' || token[0] == '+';
   char* boundary;
   const auto begin = token.c_str(), end = begin + token.size();
@@ -303,6 +498,438 @@ Term write_integer_term(const std::string& token, int base) {
   }
 }
 
+// The state set by commands such as 'big f32', which must not
+// write anything.
+Interpreter::State parse_state(const std::string& commands) {
+  std::ostringstream output;
+  Interpreter::Snapshot snapshot;
+  bool settled;
+  {
+    std::istringstream input(commands);
+    Interpreter interpreter(output);
+    parse(input, interpreter, false);
+    settled = interpreter.snapshot(snapshot) && snapshot.bits.empty();
+  }
+  if (!settled || !output.str().empty())
+    throw std::runtime_error(join("Invalid type: '", commands,
+      "'; it must only set the type, not write values."));
+  return snapshot.states.back();
+}
+
+namespace {
+
+typedef std::array<uint8_t, 128> DigitTable;
+const uint8_t invalid_digit = 0xff;
+
+DigitTable digit_table(const char* const digits) {
+  DigitTable table;
+  table.fill(invalid_digit);
+  for (uint8_t i = 0; digits[i]; ++i)
+    table[digits[i]] = i;
+  return table;
+}
+
+DigitTable hex_digit_table() {
+  auto table = digit_table("0123456789abcdef");
+  for (uint8_t i = 0; i < 6; ++i)
+    table['A' + i] = table['a' + i];
+  return table;
+}
+
+const DigitTable hex_digits = hex_digit_table();
+const DigitTable base64_digits = digit_table
+  ("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+
+uint8_t digit_value(const DigitTable& table, const uint32_t rune) {
+  return rune < table.size() ? table[rune] : invalid_digit;
+}
+
+// Decoders skip whitespace, and return the position of the
+// first invalid rune, or 'end' if there is none.
+Runes decode_hex(Runes here, const Runes end, Blob& blob,
+  std::vector<uint8_t>& octets) {
+  octets.reserve(octets.size() + (end - here) / 2);
+  for (; here != end; ++here) {
+    const auto digit = digit_value(hex_digits, *here);
+    if (digit == invalid_digit) {
+      if (is_whitespace(*here))
+        continue;
+      return here;
+    }
+    blob.bits = blob.bits << 4 | digit;
+    if (++blob.count == 2) {
+      octets.push_back(blob.bits);
+      blob.bits = 0;
+      blob.count = 0;
+    }
+  }
+  return end;
+}
+
+void finish_hex(Blob& blob, std::vector<uint8_t>&) {
+  if (blob.count != 0)
+    throw std::runtime_error("Odd number of hexadecimal digits in blob.");
+}
+
+Runes decode_base64(Runes here, const Runes end, Blob& blob,
+  std::vector<uint8_t>& octets) {
+  octets.reserve(octets.size() + (end - here) / 4 * 3);
+  for (; here != end; ++here) {
+    const auto digit = digit_value(base64_digits, *here);
+    if (digit == invalid_digit || blob.padding) {
+      if (is_whitespace(*here))
+        continue;
+      if (*here == U'=') {
+        ++blob.padding;
+        continue;
+      }
+      return here;
+    }
+    blob.bits = blob.bits << 6 | digit;
+    if (++blob.count == 4) {
+      octets.push_back(blob.bits >> 16);
+      octets.push_back(blob.bits >> 8);
+      octets.push_back(blob.bits);
+      blob.bits = 0;
+      blob.count = 0;
+    }
+  }
+  return end;
+}
+
+// Padding is optional, but must be correct if present.
+void finish_base64(Blob& blob, std::vector<uint8_t>& octets) {
+  // Padding completes a group of two or three digits.
+  if (blob.padding && (blob.count < 2 || blob.count + blob.padding != 4))
+    throw std::runtime_error("Invalid padding in base64 blob.");
+  switch (blob.count) {
+  case 1:
+    throw std::runtime_error("Truncated base64 blob.");
+  case 2:
+    octets.push_back(blob.bits >> 4);
+    break;
+  case 3:
+    octets.push_back(blob.bits >> 10);
+    octets.push_back(blob.bits >> 2);
+    break;
+  }
+}
+
+uint32_t escape_value(const uint32_t rune) {
+  switch (rune) {
+  case U'"': return U'"';
+  case U'a': return U'\a';
+  case U'b': return U'\b';
+  case U'e': return U'\e';
+  case U'f': return U'\f';
+  case U'n': return U'\n';
+  case U'r': return U'\r';
+  case U't': return U'\t';
+  case U'v': return U'\v';
+  case U'\\': return U'\\';
+  default:
+    {
+      std::string message("Invalid escape character: '");
+      utf8::append(rune, std::back_inserter(message));
+      message += "'.";
+      throw std::runtime_error(message);
+    }
+  }
+}
+
+// Splits the text between the parentheses of a function call
+// on commas. The lexer has already checked that quotes are
+// balanced and escapes are complete.
+Arguments split_arguments(const std::string& text) {
+  Arguments arguments;
+  auto here = text.begin();
+  const auto end = text.end();
+  const auto skip = [&here, &end]() {
+    while (here != end && is_whitespace(*here))
+      ++here;
+  };
+  skip();
+  if (here == end)
+    return arguments;
+  while (true) {
+    skip();
+    if (here != end && *here == '"') {
+      std::string value;
+      for (++here; *here != '"'; ++here) {
+        if (*here == '\\')
+          utf8::append(escape_value(*++here), std::back_inserter(value));
+        else
+          value += *here;
+      }
+      ++here;
+      arguments.push_back(Argument(value, true));
+    } else {
+      const auto comma = std::find(here, end, ',');
+      auto last = comma;
+      while (last != here && is_whitespace(*(last - 1)))
+        --last;
+      if (last == here)
+        throw std::runtime_error("Missing function argument.");
+      arguments.push_back(Argument(std::string(here, last), false));
+      here = comma;
+    }
+    skip();
+    if (here == end)
+      return arguments;
+    if (*here != ',')
+      throw std::runtime_error("Expected ',' between function arguments.");
+    ++here;
+  }
+}
+
+void expect_arguments(const char* const name, const Arguments& arguments,
+  const size_t minimum, const size_t maximum) {
+  if (arguments.size() < minimum || arguments.size() > maximum)
+    throw std::runtime_error(join("Function '", name, "' takes ",
+      minimum == maximum
+        ? join(minimum) : join(minimum, " to ", maximum),
+      " arguments, not ", arguments.size(), "."));
+}
+
+const std::string& string_argument(const Argument& argument) {
+  if (!argument.quoted)
+    throw std::runtime_error
+      (join("Expected string argument: '", argument.text, "'."));
+  return argument.text;
+}
+
+// Numeric arguments use the same syntax as numeric literals.
+Term literal_argument(const Argument& argument) {
+  if (argument.quoted)
+    throw std::runtime_error
+      (join("Expected numeric argument: \"", argument.text, "\"."));
+  auto token = argument.text;
+  token.erase(std::remove(token.begin(), token.end(), '_'), token.end());
+  const size_t sign = token[0] == '+' || token[0] == '-';
+  int base = 10;
+  if (token.size() > sign + 1 && token[sign] == '0') {
+    switch (token[sign + 1]) {
+    case 'b': base = 2; break;
+    case 'o': base = 8; break;
+    case 'x': base = 16; break;
+    }
+    if (base != 10)
+      token.erase(sign + 1, 1);
+  }
+  if (base == 10 && token.find('.') != std::string::npos)
+    return write_double_term(token);
+  return write_integer_term(token, base);
+}
+
+Term::Unsigned unsigned_argument(const Argument& argument) {
+  const auto term = literal_argument(argument);
+  if (term.type != Term::WRITE_UNSIGNED)
+    throw std::runtime_error
+      (join("Expected unsigned integer argument: '", argument.text, "'."));
+  return term.value.as_unsigned;
+}
+
+// at(offset) { ... }
+void at(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("at", arguments, 1, 1);
+  terms.push_back(Term::at(unsigned_argument(arguments[0])));
+}
+
+// section(name) { ... }
+void section(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("section", arguments, 1, 1);
+  terms.push_back(Term::section(string_argument(arguments[0]).c_str()));
+}
+
+// here(name = current section)
+void here(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("here", arguments, 0, 1);
+  terms.push_back(Term::here(arguments.empty()
+    ? nullptr : string_argument(arguments[0]).c_str()));
+}
+
+// size_of(name)
+void size_of(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("size_of", arguments, 1, 1);
+  terms.push_back(Term::size_of(string_argument(arguments[0]).c_str()));
+}
+
+// Names that can't be members of the struct of holes in the
+// header generated from a template: C++ keywords, the names
+// the header declares, and 'std', which the members' types
+// are qualified with.
+const std::set<std::string> reserved_names {
+  "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+  "bool", "break", "case", "catch", "char", "char8_t", "char16_t",
+  "char32_t", "class", "compl", "concept", "const", "consteval",
+  "constexpr", "constinit", "const_cast", "continue", "co_await",
+  "co_return", "co_yield", "decltype", "default", "delete", "do", "double",
+  "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+  "float", "for", "friend", "goto", "if", "inline", "int", "long",
+  "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr",
+  "operator", "or", "or_eq", "private", "protected", "public", "register",
+  "reinterpret_cast", "requires", "return", "short", "signed", "sizeof",
+  "static", "static_assert", "static_cast", "struct", "switch", "template",
+  "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+  "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+  "wchar_t", "while", "xor", "xor_eq",
+  "Holes", "encode", "size", "std",
+};
+
+// hole(name, default = 0)
+//
+// Names a value to be filled in by code generated from the
+// source as a template, which is otherwise the default.
+void hole(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("hole", arguments, 1, 2);
+  const auto& name = string_argument(arguments[0]);
+  if (name.empty() || is_decimal(name[0]) || std::find_if(name.begin(),
+    name.end(), [](const char c) { return !is_alphanumeric(c) && c != '_'; })
+      != name.end())
+    throw std::runtime_error(join("Invalid hole name: '", name,
+      "'; it must be a C++ identifier."));
+  // Names with a double underscore, or an underscore and a
+  // capital letter, are reserved to the implementation.
+  if (reserved_names.count(name) || name.find("__") != std::string::npos
+    || (name[0] == '_' && name.size() > 1 && name[1] >= 'A' && name[1] <= 'Z'))
+    throw std::runtime_error(join("Invalid hole name: '", name,
+      "'; it is reserved in the generated C++."));
+  terms.push_back(Term::hole(name.c_str()));
+  terms.push_back(arguments.size() > 1 ? literal_argument(arguments[1])
+    : Term::write(Term::Unsigned(0)));
+}
+
+// include_bytes(path, offset = 0, size = rest of file)
+void include_bytes(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("include_bytes", arguments, 1, 3);
+  terms.push_back(Term::include(string_argument(arguments[0]).c_str(),
+    arguments.size() > 1 ? unsigned_argument(arguments[1]) : 0,
+    arguments.size() > 2 ? unsigned_argument(arguments[2])
+      : std::numeric_limits<Term::Unsigned>::max()));
+}
+
+// random(seed, count)
+void random(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("random", arguments, 2, 2);
+  terms.push_back(Term::random
+    (unsigned_argument(arguments[0]), unsigned_argument(arguments[1])));
+}
+
+Term::Signed signed_bound(const Term& bound) {
+  if (bound.type == Term::WRITE_UNSIGNED
+    && bound.value.as_unsigned > Term::Unsigned
+      (std::numeric_limits<Term::Signed>::max()))
+    throw std::runtime_error(join("Bound (", bound.value.as_unsigned,
+      ") exceeds range of signed 64-bit integer."));
+  return bound.value.as_signed;
+}
+
+double double_bound(const Term& bound) {
+  switch (bound.type) {
+  case Term::WRITE_SIGNED:
+    return bound.value.as_signed;
+  case Term::WRITE_UNSIGNED:
+    return bound.value.as_unsigned;
+  default:
+    return bound.value.as_double;
+  }
+}
+
+// The values from 'start' up to but excluding 'stop'. If any
+// bound is floating-point, so is the sequence; otherwise, if
+// any bound is signed, so is the sequence.
+Term::Sequence sequence(const Argument& start_argument,
+  const Argument& stop_argument, const Argument* const step_argument) {
+  const Term start = literal_argument(start_argument),
+    stop = literal_argument(stop_argument),
+    step = step_argument
+      ? literal_argument(*step_argument) : Term::write(uint64_t(1));
+  const Term* const bounds[] = { &start, &stop, &step };
+  Term::Sequence sequence;
+  sequence.type = Term::WRITE_UNSIGNED;
+  for (const auto bound : bounds) {
+    if (bound->type == Term::WRITE_DOUBLE)
+      sequence.type = Term::WRITE_DOUBLE;
+    else if (bound->type == Term::WRITE_SIGNED
+      && sequence.type == Term::WRITE_UNSIGNED)
+      sequence.type = Term::WRITE_SIGNED;
+  }
+  switch (sequence.type) {
+  case Term::WRITE_DOUBLE:
+    {
+      const auto first = double_bound(start), last = double_bound(stop),
+        increment = double_bound(step);
+      if (increment == 0 || increment != increment)
+        throw std::runtime_error("Step must be a nonzero number.");
+      const auto count = std::ceil((last - first) / increment);
+      if (!(count < std::ldexp(1.0, 64)))
+        throw std::runtime_error("Sequence is too long.");
+      sequence.start.as_double = first;
+      sequence.step.as_double = increment;
+      sequence.count = count > 0 ? Term::Unsigned(count) : 0;
+    }
+    break;
+  case Term::WRITE_SIGNED:
+    {
+      const auto first = signed_bound(start), last = signed_bound(stop),
+        increment = signed_bound(step);
+      if (increment == 0)
+        throw std::runtime_error("Step must be nonzero.");
+      // Distances are computed modulo 2^64, where they are exact.
+      sequence.start.as_signed = first;
+      sequence.step.as_signed = increment;
+      if (increment > 0)
+        sequence.count = first >= last ? 0
+          : (Term::Unsigned(last) - Term::Unsigned(first) - 1)
+            / Term::Unsigned(increment) + 1;
+      else
+        sequence.count = first <= last ? 0
+          : (Term::Unsigned(first) - Term::Unsigned(last) - 1)
+            / (0 - Term::Unsigned(increment)) + 1;
+    }
+    break;
+  default:
+    {
+      const auto first = start.value.as_unsigned,
+        last = stop.value.as_unsigned, increment = step.value.as_unsigned;
+      if (increment == 0)
+        throw std::runtime_error("Step must be nonzero.");
+      sequence.start.as_unsigned = first;
+      sequence.step.as_unsigned = increment;
+      sequence.count = first >= last ? 0 : (last - first - 1) / increment + 1;
+    }
+  }
+  return sequence;
+}
+
+// range(start, stop, step = 1)
+void range(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  expect_arguments("range", arguments, 2, 3);
+  call.sequences.push_back(sequence(arguments[0], arguments[1],
+    arguments.size() > 2 ? &arguments[2] : nullptr));
+  terms.push_back(Term::sequence(&call.sequences[0], 1));
+}
+
+// grid(start, stop, step, ...), one triple per dimension.
+void grid(Call& call, Terms& terms) {
+  const auto& arguments = call.arguments;
+  if (arguments.empty() || arguments.size() % 3 != 0)
+    throw std::runtime_error(join("Function 'grid' takes a multiple of 3 "
+      "arguments, not ", arguments.size(), "."));
+  for (size_t i = 0; i < arguments.size(); i += 3)
+    call.sequences.push_back
+      (sequence(arguments[i], arguments[i + 1], &arguments[i + 2]));
+  terms.push_back(Term::sequence(&call.sequences[0], call.sequences.size()));
+}
+
 unsigned long parse_width(const std::string& token) {
   const auto begin = token.c_str() + 1;
   char* boundary;
@@ -361,6 +988,24 @@ bool accept_if(P predicate, I& input, I end) {
   return false;
 }
 
+// An exponent such as 'e-7' is part of a float literal only
+// if digits follow it, so '1.5epsilon' is still a literal
+// followed by a command.
+template<class I, class O>
+bool accept_exponent(I& input, const I end, O output) {
+  auto next = input;
+  if (next == end || (*next != U'e' && *next != U'E'))
+    return false;
+  ++next;
+  if (next != end && (*next == U'+' || *next == U'-'))
+    ++next;
+  if (next == end || !is_decimal(*next))
+    return false;
+  while (input != next)
+    utf8::append(*input++, output);
+  return true;
+}
+
 template<class T, class... Args>
 bool transition(T& state, const T& target, Args&&... args) {
   if (accept(std::forward<Args>(args)...)) {
@@ -1,12 +1,19 @@
 #ifndef PROTODATA_PARSE_H
 #define PROTODATA_PARSE_H
 
+#include <Interpreter.h>
+#include <Term.h>
+
 #include <cstdint>
 #include <iosfwd>
+#include <string>
 #include <vector>
 
-class Interpreter;
+void parse(std::istream&, Interpreter&, bool);
+Interpreter::State parse_state(const std::string&);
 
-void parse(std::istream&, Interpreter&);
+// Literal conversions, exposed for benchmarking.
+Term write_double_term(const std::string&);
+Term write_integer_term(const std::string&, int);
 
 #endif
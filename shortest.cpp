@@ -0,0 +1,215 @@
+#include <shortest.h>
+
+#include <algorithm>
+#include <vector>
+
+// After Raffaello Giulietti, "The Schubfach way to render
+// doubles" (2020), as in Java's 'DoubleToDecimal'. A value
+// c × 2^q has a rounding interval from halfway to the value
+// below it to halfway to the value above it, which includes
+// its ends if c is even. Scaled by a power of ten such that
+// the interval is between 1 and 10 units wide, the shortest
+// decimal in it is an integer, found by comparing the scaled
+// ends with the integers nearest the scaled value.
+
+namespace {
+
+// The decimal exponents of powers of ten needed for doubles,
+// which serve narrower formats as well.
+const int k_min = -324;
+const int k_max = 292;
+
+const uint64_t mask_63 = (uint64_t(1) << 63) - 1;
+
+// The floor of e × log2(10), for |e| <= 1233.
+int flog2pow10(const int e) {
+  return int(int64_t(e) * 217706 >> 16);
+}
+
+// The floor of q × log10(2), for |q| <= 5456721.
+int flog10pow2(const int q) {
+  return int(int64_t(q) * 661971961083 >> 41);
+}
+
+// The floor of q × log10(2) + log10(3/4), for |q| <= 5456721.
+int flog10three_quarters_pow2(const int q) {
+  return int((int64_t(q) * 661971961083 - 274743187321) >> 41);
+}
+
+uint64_t multiply_high(const uint64_t a, const uint64_t b) {
+  return uint64_t((unsigned __int128)a * b >> 64);
+}
+
+// An approximation from above of 10^-k × 2^-r, for the r that
+// puts it in [2^125, 2^126), as its high and low 63 bits.
+struct Power {
+  uint64_t high;
+  uint64_t low;
+};
+
+// A natural number in base 2^32, least significant digit
+// first, just enough to compute the powers once.
+typedef std::vector<uint32_t> Natural;
+
+void multiply(Natural& n, const uint32_t factor) {
+  uint64_t carry = 0;
+  for (auto& digit : n) {
+    carry += uint64_t(digit) * factor;
+    digit = uint32_t(carry);
+    carry >>= 32;
+  }
+  if (carry)
+    n.push_back(uint32_t(carry));
+}
+
+void divide(Natural& n, const uint32_t divisor) {
+  uint64_t remainder = 0;
+  for (size_t i = n.size(); i-- > 0;) {
+    remainder = remainder << 32 | n[i];
+    n[i] = uint32_t(remainder / divisor);
+    remainder %= divisor;
+  }
+  while (n.size() > 1 && n.back() == 0)
+    n.pop_back();
+}
+
+// Multiplies by 2^shift, rounding down if it's negative.
+void scale(Natural& n, const int shift) {
+  if (shift >= 0) {
+    n.insert(n.begin(), shift / 32, 0);
+    multiply(n, uint32_t(1) << shift % 32);
+  } else {
+    n.erase(n.begin(), n.begin() + std::min<size_t>(-shift / 32, n.size()));
+    divide(n, uint32_t(1) << -shift % 32);
+  }
+}
+
+Power power(const int k) {
+  const int e = -k, r = flog2pow10(e) - 125;
+  Natural n(1, 1);
+  for (int i = 0; i < e; ++i)
+    multiply(n, 10);
+  scale(n, -r);
+  for (int i = 0; i > e; --i)
+    divide(n, 10);
+  for (auto& digit : n)
+    if (++digit != 0)
+      break;
+  const auto bit = [&](const int i) {
+    return uint64_t(n[i / 32] >> i % 32 & 1);
+  };
+  Power result = { 0, 0 };
+  for (int i = 62; i >= 0; --i) {
+    result.high = result.high << 1 | bit(i + 63);
+    result.low = result.low << 1 | bit(i);
+  }
+  return result;
+}
+
+// Computed on first use, which takes about a millisecond.
+const Power& powers(const int k) {
+  static const std::vector<Power> table = [] {
+    std::vector<Power> table;
+    for (int k = k_min; k <= k_max; ++k)
+      table.push_back(power(k));
+    return table;
+  }();
+  return table[k - k_min];
+}
+
+// The product of 'g' and 'cp', scaled down by 2^127 and
+// rounded to odd, which keeps ties apart from inexact values.
+uint64_t rop(const Power& g, const uint64_t cp) {
+  const uint64_t x1 = multiply_high(g.low, cp);
+  const uint64_t y0 = g.high * cp;
+  const uint64_t y1 = multiply_high(g.high, cp);
+  const uint64_t z = (y0 >> 1) + x1;
+  const uint64_t vbp = y1 + (z >> 63);
+  return vbp | ((z & mask_63) + mask_63) >> 63;
+}
+
+// The shortest decimal for c × 2^q, in a format
+// whose least exponent is 'q_min' and whose least normal
+// significand is 'c_min'.
+Decimal to_decimal(const int q, const uint64_t c, const int q_min,
+  const uint64_t c_min) {
+  const uint64_t out = c & 1;
+  const uint64_t cb = c << 2;
+  const uint64_t cbr = cb + 2;
+  uint64_t cbl;
+  int k;
+  // Below a power of two, values are closer together.
+  if (c != c_min || q == q_min) {
+    cbl = cb - 2;
+    k = flog10pow2(q);
+  } else {
+    cbl = cb - 1;
+    k = flog10three_quarters_pow2(q);
+  }
+  const int h = q + flog2pow10(-k) + 2;
+  const auto& g = powers(k);
+  const uint64_t vb = rop(g, cb << h);
+  const uint64_t vbl = rop(g, cbl << h);
+  const uint64_t vbr = rop(g, cbr << h);
+  const uint64_t s = vb >> 2;
+  // Narrower significands leave room to judge closeness more
+  // finely.
+  const int finer = c_min >> 32 ? 0 : 24;
+  const uint64_t fine_l = finer ? rop(g, cbl << (h + finer)) : vbl;
+  const uint64_t fine_r = finer ? rop(g, cbr << (h + finer)) : vbr;
+  const auto decimal = [&](const uint64_t digits) {
+    const uint64_t scaled = digits << (2 + finer);
+    const Decimal result
+      = { digits, k, scaled < fine_l + 2 || scaled + 2 > fine_r };
+    return result;
+  };
+  // One digit fewer, if the interval holds a multiple of ten.
+  // Unlike in Java, which writes at least two digits, this
+  // applies to two digits as well.
+  if (s >= 10) {
+    const uint64_t sp10
+      = 10 * multiply_high(s, uint64_t(115292150460684698) << 4);
+    const uint64_t tp10 = sp10 + 10;
+    const bool upin = vbl + out <= sp10 << 2;
+    const bool wpin = (tp10 << 2) + out <= vbr;
+    if (upin != wpin)
+      return decimal(upin ? sp10 : tp10);
+  }
+  const uint64_t t = s + 1;
+  const bool uin = vbl + out <= s << 2;
+  const bool win = (t << 2) + out <= vbr;
+  if (uin != win)
+    return decimal(uin ? s : t);
+  // Both are in the interval, so the closer one wins, or the
+  // even one in a tie.
+  const int64_t cmp = int64_t(vb - ((s + t) << 1));
+  return decimal(cmp < 0 || (cmp == 0 && (s & 1) == 0) ? s : t);
+}
+
+}
+
+Decimal shortest(const uint64_t bits, const int precision,
+  const int exponent_bits) {
+  const int q_min = 3 - (1 << (exponent_bits - 1)) - precision;
+  const uint64_t c_min = uint64_t(1) << (precision - 1);
+  const uint64_t t = bits & (c_min - 1);
+  const int bq = int(bits >> (precision - 1));
+  if (bq != 0) {
+    const int mq = -q_min + 1 - bq;
+    const uint64_t c = c_min | t;
+    // Integers are written as they are.
+    if (0 < mq && mq < precision) {
+      const uint64_t f = c >> mq;
+      if (f << mq == c) {
+        const Decimal result = { f, 0, false };
+        return result;
+      }
+    }
+    return to_decimal(-mq, c, q_min, c_min);
+  }
+  if (t == 0) {
+    const Decimal zero = { 0, 0, false };
+    return zero;
+  }
+  return to_decimal(q_min, t, q_min, c_min);
+}
@@ -0,0 +1,25 @@
+#ifndef PROTODATA_SHORTEST_H
+#define PROTODATA_SHORTEST_H
+
+#include <cstdint>
+
+// The value 'digits' × 10^'exponent', and whether it's close
+// to either end of the interval of values that round to the
+// binary value: within a quarter of a unit in its last digit,
+// or for significands of up to 32 bits, 2^-26 of one.
+struct Decimal {
+  uint64_t digits;
+  int exponent;
+  bool close;
+};
+
+// The decimal with the fewest significant digits that rounds
+// to a binary floating-point value, and of those the closest,
+// computed exactly with the Schubfach algorithm. The value is
+// the magnitude 'bits' of an IEEE 754 format with 'precision'
+// bits of significand, counting the implicit one, of up to 53,
+// and 'exponent_bits' bits of exponent, of up to 11. It must
+// be finite.
+Decimal shortest(uint64_t bits, int precision, int exponent_bits);
+
+#endif
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Checks that writing output with '--io-uring', '--direct', and
+# '--mmap' gives the same output and errors as ordinary writes,
+# for every test input and a few large ones. An option is
+# skipped where the system doesn't support what it relies on.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: backends.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+function fail {
+  echo "Test 'backends' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+options=(--mmap)
+if [ "$(cat /proc/sys/kernel/io_uring_disabled 2> /dev/null || echo 0)" \
+  = 0 ]; then
+  options+=(--io-uring)
+  if dd if=/dev/zero of="$work/direct" bs=4096 count=1 oflag=direct \
+    2> /dev/null; then
+    options+=(--direct)
+  else
+    echo "Skipping '--direct': O_DIRECT is unsupported in '$work'."
+  fi
+else
+  echo "Skipping '--io-uring' and '--direct': io_uring is disabled."
+fi
+
+# Checks that ARGUMENTS write the same output and errors with
+# each option as without.
+function same {
+  rm -f "$work/expected"
+  "$PD" "$@" -o "$work/expected" 2> "$work/expected.err"
+  for option in "${options[@]}"; do
+    rm -f "$work/actual"
+    "$PD" "$option" "$@" -o "$work/actual" 2> "$work/actual.err"
+    cmp -s "$work/expected" "$work/actual" \
+      || fail "Output of '$*' differs with '$option'."
+    cmp -s "$work/expected.err" "$work/actual.err" \
+      || fail "Errors of '$*' differ with '$option': $(cat "$work/actual.err")"
+  done
+}
+
+# Paths in the tests are relative to this directory.
+for test_file in ./*.pd; do
+  same "$test_file"
+done
+
+# Outputs of several blocks, with unaligned and placed writes,
+# and a large file included at an unaligned position.
+"$PD" -e 'u32 range(0, 1000000)' -o "$work/large" \
+  || fail "Unable to compile a large output."
+same -e 'u32 range(0, 1000000)'
+same -e 'u8 1 u32 range(0, 1000000) u8 2'
+same -e 'u8 1 at(10000) { u32 range(0, 5000) } u16 range(0, 30000)'
+same -e 'u8 1 u16 range(0, 30000) at(1000000) { u8 2 } at(3) { u8 3 }'
+same -e "u8 1 include_bytes(\"$work/large\") u8 2"
+
+echo "Test 'backends' passed."
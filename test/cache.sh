@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Checks that output spliced in from a cache is the same as a
+# plain compile gives, whether inputs are unchanged or edited,
+# and that entries aren't reused by a different executable.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: cache.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+function fail {
+  echo "Test 'cache' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Compiles the inputs with 'pd', or the given executable, both
+# with and without the cache.
+function compare {
+  local pd="${PD_UNDER_TEST:-$PD}"
+  "$pd" --cache "$work/cache" "$@" -o "$work/cached" ||
+    fail "Unable to compile with the cache."
+  "$pd" "$@" -o "$work/plain" || fail "Unable to compile."
+  cmp -s "$work/plain" "$work/cached" ||
+    fail "Output from the cache differs from a plain compile."
+}
+
+function entries {
+  find "$work/cache" -type f | wc -l
+}
+
+cd "$work"
+echo 'u8 1 2 3 big u16 500' > a.pd
+echo 'u16 delta 7 9 { 10 } absolute u3 5' > b.pd
+echo 'u8 11 x"ff" utf8 "é"' > c.pd
+
+compare a.pd b.pd c.pd
+[ "$(entries)" -eq 3 ] || fail "Expected an entry for each input."
+compare a.pd b.pd c.pd
+[ "$(entries)" -eq 3 ] || fail "Unchanged inputs were not reused."
+
+echo 'u8 12' >> b.pd
+compare a.pd b.pd c.pd
+[ "$(entries)" -eq 5 ] ||
+  fail "Expected new entries for an edited input and the one after it."
+
+cp "$PD" other-pd
+echo >> other-pd
+PD_UNDER_TEST=./other-pd compare a.pd b.pd c.pd
+[ "$(entries)" -eq 8 ] ||
+  fail "Entries were reused by a different executable."
+
+# Positions depend on everything before them, so an input that
+# writes one is compiled again when an earlier one changes size.
+echo 'u8 1 2' > a.pd
+echo 'absolute u32 here() u8 9' > d.pd
+compare a.pd b.pd d.pd
+echo 'u8 3' >> a.pd
+compare a.pd b.pd d.pd
+
+echo "Test 'cache' passed."
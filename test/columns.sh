@@ -0,0 +1,147 @@
+#!/bin/bash
+
+# Checks that rows imported with '--columns' are written as the
+# equivalent source would be, with and without delimiters and
+# alignment, and that invalid rows and layouts are reported.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: columns.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'columns' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Imports INPUT with the given options, and compares the output
+# with that of SOURCE.
+function imports_as {
+  local input="$1" source="$2"
+  shift 2
+  printf "$input" > input
+  "$PD" "$@" input -o imported || fail "Unable to import with '$*'."
+  "$PD" -e "$source" -o compiled || fail "Unable to compile '$source'."
+  cmp -s compiled imported || fail "Import with '$*' is not '$source'."
+}
+
+# Imports INPUT with the given options, which must fail with
+# MESSAGE.
+function rejects {
+  local input="$1" message="$2"
+  shift 2
+  printf "$input" > input
+  "$PD" "$@" input -o imported 2> error &&
+    fail "Import with '$*' succeeded."
+  [ "$(cat error)" = "$message" ] ||
+    fail "Import with '$*' failed with: $(cat error)"
+}
+
+# Fields separated by any whitespace, and comments.
+imports_as '1 2.5 3\n4 5 6\n' 'u16 1 f32 2.5 3.0 u16 4 f32 5.0 6.0' \
+  --columns 'u16 f32 f32'
+imports_as '# id value\n1\n2.5  3\t4\n\n5 6' \
+  'u16 1 f32 2.5 3.0 u16 4 f32 5.0 6.0' --columns 'u16 f32 f32'
+imports_as '1e3 nan -inf +7 -5\n' 'f64 1000.0 nan -inf s8 +7 -5' \
+  --columns 'f64 f64 f64 s8 s8'
+imports_as '1 2 3 4\n' 'big u16 1 u32 2 little u16 3 u32 4' \
+  --columns 'big u16 u32 little u16 u32'
+imports_as '10 7 11 9 13 12\n' 'u8 10 u16 7 u8 1 u16 2 u8 2 u16 3' \
+  --columns 'delta u8 u16'
+imports_as '1 2 3 4 5 6\n' 'u3 1 u5 2 u3 3 u5 4 u3 5 u5 6' \
+  --columns 'u3 u5'
+
+# Delimited fields, a record to a line.
+imports_as '1,2.5\n3, 4\r\n' 'u8 1 f32 2.5 u8 3 f32 4.0' \
+  --columns 'u8 f32' --delimiter ,
+imports_as '1\t-2\n3\t4' 'u8 1 s8 -2 u8 3 s8 4' \
+  --columns 'u8 s8' --delimiter '\t'
+imports_as '1;2\n' 'u8 1 2' --columns 'u8 u8' --delimiter ';'
+
+# Alignment, as of a C struct.
+imports_as '1 2 3\n4 5 6\n' \
+  'u8 1 0 0 0 u32 2 u16 3 u8 0 0 u8 4 0 0 0 u32 5 u16 6 u8 0 0' \
+  --columns 'u8 u32 u16' --align
+imports_as '1 2\n' 'u8 1 0 0 0 0 0 0 0 f64 2.0' --columns 'u8 f64' --align
+imports_as '1 2\n' 'u16 1 u8 2 0' --columns 'u16 u8' --align
+
+# Invalid rows.
+rejects '1,,2\n' "In input input:
+  At line 1, column 3:
+    Empty field." --columns 'u8 u8' --delimiter ,
+rejects '1,2,\n' "In input input:
+  At line 1, column 5:
+    Empty field." --columns 'u8 u8' --delimiter ,
+rejects '1,2\n3,4,5\n' "In input input:
+  At line 2, column 5:
+    Expected 2 columns but found more." --columns 'u8 u8' --delimiter ,
+rejects '1\n' "In input input:
+  At line 1, column 2:
+    Expected 2 columns but found 1." --columns 'u8 u8' --delimiter ,
+rejects '1,2 3\n' "In input input:
+  At line 1, column 5:
+    Expected delimiter between fields." --columns 'u8 u8' --delimiter ,
+rejects '1 2 3\n' \
+  "Incomplete record at end of input; expected 2 columns but found 1." \
+  --columns 'u8 u8'
+rejects '1 x\n' "In input input:
+  At line 1, column 3:
+    Invalid number: 'x'." --columns 'u8 u8'
+rejects '1 2\n300 4\n' "In input input:
+  At line 2, column 1:
+    Value exceeds range of unsigned 8-bit integer." --columns 'u8 u8'
+rejects '1.5\n' "In input input:
+  At line 1, column 1:
+    Float values cannot be written in integer format." --columns 'u8'
+
+# Lines longer than the blocks the input is read in, of fields
+# and of a comment, read as the same fields on lines of their own.
+seq 0 300000 > lines
+seq -s ' ' 0 300000 > line
+"$PD" --columns 'u32' lines -o expected || fail "Unable to import lines."
+"$PD" --columns 'u32' line -o imported || fail "Unable to import a long line."
+cmp -s expected imported || fail "A long line was imported differently."
+{ printf '# '; head -c 3000000 /dev/zero | tr '\0' x; printf '\n'; } \
+  > comment
+cat comment lines > input
+"$PD" --columns 'u32' input -o imported \
+  || fail "Unable to import after a long comment."
+cmp -s expected imported || fail "A long comment was imported as fields."
+{ seq -s ' ' 0 300000 | tr -d '\n'; printf ' x\n'; } > input
+"$PD" --columns 'u32' input -o imported 2> error &&
+  fail "Import of an invalid field on a long line succeeded."
+[ "$(cat error)" = "In input input:
+  At line 1, column $(($(stat -c %s line) + 1)):
+    Invalid number: 'x'." ] ||
+  fail "Import of an invalid field on a long line failed with: $(cat error)"
+head -c 3000000 /dev/zero | tr '\0' 1 > input
+"$PD" --columns 'u32' input -o imported 2> error &&
+  fail "Import of a long field succeeded."
+[ "$(cat error)" = "In input input:
+  At line 1, column 1:
+    Field longer than 1048576 bytes." ] ||
+  fail "Import of a long field failed with: $(cat error)"
+
+# Invalid layouts and options.
+rejects '' "Unable to align column 'u3'; only 8-, 16-, 32-, and 64-bit\
+ integers and floats can be aligned." --columns 'u8 u3' --align
+rejects '' "At line 1, column 0:
+  Unimplemented command: 'foo'." --columns 'u8 foo'
+rejects '' "No columns in layout: 'big'." --columns 'big'
+rejects '' "Expected a column after 'delta' in layout: 'u8 delta'." \
+  --columns 'u8 delta'
+rejects '' "Invalid value for option: '--columns'." --columns ''
+rejects '' "Invalid delimiter: '1'; it must be one character that can't\
+ begin a number." --columns 'u8' --delimiter 1
+rejects '' "Option '--delimiter' requires '--columns'." --delimiter ,
+rejects '' "Option '--align' requires '--columns'." --align
+
+echo "Test 'columns' passed."
@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# Checks that compressed output is an LZ4 frame, or zstd in
+# builds that support it, that decompresses to the same bytes
+# as uncompressed output, using the 'lz4' and 'zstd' tools
+# where they are installed.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: compress.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'compress' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+lz4="$(command -v lz4)"
+zstd="$(command -v zstd)"
+"$PD" --compress=zstd -e '' -o /dev/null 2> /dev/null || zstd=
+
+# Checks that COMPRESSED, written in FORMAT, begins with its
+# magic number and decompresses to the file 'plain'.
+function check {
+  local compressed="$1" format="$2" magic tool
+  if [ "$format" = lz4 ]; then
+    magic=04224d18 tool="$lz4"
+  else
+    magic=28b52ffd tool="$zstd"
+  fi
+  [ "$(od -An -tx1 -N4 "$compressed" | tr -d ' ')" = "$magic" ] ||
+    fail "'$compressed' doesn't begin with the magic number of $format."
+  if [ -n "$tool" ]; then
+    "$tool" -dc "$compressed" > decompressed ||
+      fail "'$compressed' can't be decompressed as $format."
+    cmp -s plain decompressed ||
+      fail "'$compressed' doesn't decompress to the uncompressed output."
+  fi
+}
+
+# Compiles SOURCE compressed in each format, and uncompressed.
+function compresses {
+  "$PD" -e "$1" -o plain || fail "Unable to compile '$1'."
+  "$PD" -e "$1" --compress -o compressed ||
+    fail "Unable to compile '$1' compressed."
+  check compressed lz4
+  if [ -n "$zstd" ]; then
+    "$PD" -e "$1" --compress=zstd -o compressed ||
+      fail "Unable to compile '$1' compressed with zstd."
+    check compressed zstd
+  fi
+}
+
+compresses ''
+compresses 'u8 1 2 3'
+compresses 'u3 1 2 3 4 5'
+compresses 'utf8 "compressible compressible compressible compressible"'
+# Several blocks, compressible and not.
+compresses 'big u32 range(0, 3000000)'
+compresses 'u64 random(1, 1000000)'
+compresses 'u8 range(0, 100) u64 random(2, 600000) u32 range(0, 2000000)'
+
+# Paths ending in '.lz4' or '.zst' are always compressed,
+# including those of sections.
+"$PD" -e 'u16 range(0, 1000) section("s") { u16 range(0, 500) }' \
+  -o plain -o s=section-plain || fail "Unable to compile sections."
+"$PD" -e 'u16 range(0, 1000) section("s") { u16 range(0, 500) }' \
+  -o output.lz4 -o s=section.lz4 ||
+  fail "Unable to compile sections to '.lz4' paths."
+check output.lz4 lz4
+mv section-plain plain
+check section.lz4 lz4
+if [ -n "$zstd" ]; then
+  "$PD" -e 'u16 range(0, 1000)' -o plain &&
+    "$PD" -e 'u16 range(0, 1000)' -o output.zst ||
+    fail "Unable to compile to a '.zst' path."
+  check output.zst zstd
+fi
+
+echo "Test 'compress' passed."
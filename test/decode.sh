@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# Checks that binary decoded with '--decode' compiles back to
+# the same bytes, for values of every format, and for bytes
+# that no value encodes to, which must be kept as raw units.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: decode.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+function fail {
+  echo "Test 'decode' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Decodes the bytes given in hexadecimal as TYPE, compiles the
+# result, and compares it with the bytes.
+function round_trip {
+  local type="$1" hex="$2"
+  printf "$(sed 's/[0-9a-f][0-9a-f]/\\x&/g' <<< "$hex")" > "$work/input"
+  "$PD" --decode "$type" "$work/input" -o "$work/decoded.pd" ||
+    fail "Unable to decode '$hex' as '$type'."
+  "$PD" "$work/decoded.pd" -o "$work/output" ||
+    fail "Unable to compile '$hex' decoded as '$type'."
+  cmp -s "$work/input" "$work/output" ||
+    fail "'$hex' decoded as '$type' compiles to different bytes."
+}
+
+# Also compares the decoded source with what's expected.
+function decodes_to {
+  round_trip "$1" "$2"
+  [ "$(cat "$work/decoded.pd")" = "$3" ] ||
+    fail "'$2' decoded as '$1' is not '$3': $(cat "$work/decoded.pd")"
+}
+
+# Integers of whole bytes and of odd widths, and trailing bits.
+round_trip u8 '00017f80ff'
+round_trip 'big s32' '80000000ffffffff00000001'
+round_trip 'little u16' '0100ffff02'
+round_trip s64 '0000000000000080ffffffffffffffff'
+round_trip u3 'fa5c'
+round_trip s5 '8421f7'
+round_trip 'big s13' '8000fffc01'
+round_trip u1 'a5'
+
+# Floats, including NaNs with payloads, infinities, negative
+# zero, and subnormals.
+round_trip f16 '007c00fc007e017e00800100ff7b'
+round_trip bf16 '807f807fc17f0080'
+round_trip 'big f32' '7f8000017fc00000ffc0000180000000000000013f800000'
+round_trip f64 '000000000000f87f010000000000f87f000000000000f0ff0000000000000080'
+round_trip 'big f64' '3ff00000000000007ff0000000000001'
+round_trip f32 '0000803f00'
+
+# Unicode, with invalid sequences and units.
+decodes_to utf8 '68c3a9e282ac' 'native absolute utf8
+"hé€"'
+round_trip utf8 '61c328e282ffc0afeda080f4908080f09f98'
+round_trip 'little utf16' '410000d8420000dc3dd800de'
+round_trip 'big utf16' '0041d83dde00dc00d8000041'
+round_trip utf16 '4100ff'
+
+# Variable-length integers, with encodings that aren't the
+# shortest, that overflow 64 bits, or that are cut off.
+round_trip uleb128 '00017f8001ffffffffffffffffff018000'
+round_trip uleb128 '8080808080808080808002'
+round_trip sleb128 '007f40c0bb78ff7e'
+round_trip sleb128 '808080808080808080807f80'
+round_trip zigzag '000102038001feffffffffffffffff01'
+round_trip prefix_varint '0002fe0301ffffffffffffffffffff'
+round_trip prefix_varint '0503'
+
+# Relative values, which decode to the values written.
+decodes_to 'delta u8' '01010109' 'native delta u8
+1 2 3 12'
+decodes_to 'for big s16' '03e80001fffe' 'big for s16
+1000 1001 998'
+round_trip 'delta uleb128' '0a0180010080'
+round_trip 'delta zigzag' 'd00f0203'
+round_trip 'for u3' 'ab'
+
+# Binary that begins like compressed source is decoded as it is.
+decodes_to u8 '1f8b0800' 'native absolute u8
+31 139 8 0'
+decodes_to 'big u16' '28b52ffd' 'big absolute u16
+10421 12285'
+
+echo "Test 'decode' passed."
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Checks that the encoder generated from 'holes.pd' writes the
+# same output as the template compiles to, both with its
+# defaults and with the holes of a copy without them filled in
+# with the same values.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: emit-cpp.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+CXX="${CXX:-c++}"
+
+function fail {
+  echo "Test 'emit-cpp' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+"$PD" holes.pd --emit-cpp holes -o holes.h.actual ||
+  fail "Unable to generate an encoder."
+sed 's/hole(\("[a-z_]*"\), [^)]*)/hole(\1)/g' holes.pd |
+  "$PD" --emit-cpp zeroed -o zeroed.h.actual ||
+  fail "Unable to generate an encoder without defaults."
+
+cat > emit-cpp.cpp.actual <<'END'
+#include "holes.h.actual"
+#include "zeroed.h.actual"
+
+#include <cstdio>
+
+int main(int, char** argv) {
+  std::uint8_t defaulted[holes::size], filled[zeroed::size];
+  const holes::Holes defaults;
+  zeroed::Holes values;
+  values.id = defaults.id;
+  values.zero = defaults.zero;
+  values.flags = defaults.flags;
+  values.small = defaults.small;
+  values.offset = defaults.offset;
+  values.unaligned = defaults.unaligned;
+  values.delta = defaults.delta;
+  values.length = defaults.length;
+  values.sum = defaults.sum;
+  values.big_value = defaults.big_value;
+  values.mark = defaults.mark;
+  values.ratio = defaults.ratio;
+  values.scale = defaults.scale;
+  values.count = defaults.count;
+  values.nibble = defaults.nibble;
+  values.aligned = defaults.aligned;
+  values.word = defaults.word;
+  if (!holes::encode(defaults, defaulted) || !zeroed::encode(values, filled))
+    return 1;
+  zeroed::Holes out_of_range;
+  out_of_range.delta = -5;
+  if (zeroed::encode(out_of_range, filled))
+    return 1;
+  std::fwrite(defaulted, 1, sizeof defaulted, std::fopen(argv[1], "wb"));
+  std::fwrite(filled, 1, sizeof filled, std::fopen(argv[2], "wb"));
+}
+END
+
+$CXX -std=c++0x -Wall -Wextra -pedantic -Werror -x c++ emit-cpp.cpp.actual \
+  -o emit-cpp.actual || fail "Unable to compile the generated encoders."
+./emit-cpp.actual defaulted.out.actual filled.out.actual ||
+  fail "Encoding failed, or an out-of-range value was written."
+diff -q holes.out.expect defaulted.out.actual ||
+  fail "Output with defaults does not match the template's."
+diff -q holes.out.expect filled.out.actual ||
+  fail "Output with values filled in does not match the template's."
+
+echo "Test 'emit-cpp' passed."
@@ -0,0 +1,152 @@
+// Checks the float literals written by '--decode' against a
+// search on the number of digits with 'printf' and 'strtod',
+// which is exact but too slow to decode with: each literal
+// must encode to its value, in no more significant digits
+// than the search finds. The search rounds to the nearest
+// literal of each length, so below a power of two, where the
+// interval is uneven, it can miss a shorter one. Every f16 and bf16 value is checked, and
+// a sample of f32 and f64 values.
+//
+//     float-literals
+
+#include <decode.h>
+#include <parse.h>
+#include <write.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace {
+
+uint64_t narrow(const Interpreter::State& state, const double value) {
+  if (state.format == Term::BFLOAT)
+    return bfloat_from_double(value);
+  if (state.width == 16)
+    return half_from_double(value);
+  if (state.width == 32) {
+    const float narrowed(value);
+    uint32_t bits;
+    std::memcpy(&bits, &narrowed, sizeof(bits));
+    return bits;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double widen(const Interpreter::State& state, const uint64_t bits) {
+  if (state.format == Term::BFLOAT || state.width == 32) {
+    const uint32_t single = state.format == Term::BFLOAT ? bits << 16 : bits;
+    float value;
+    std::memcpy(&value, &single, sizeof(value));
+    return value;
+  }
+  if (state.width == 16) {
+    const int exponent = bits >> 10 & 0x1f;
+    const double magnitude = exponent == 0 ? std::ldexp(bits & 0x3ff, -24)
+      : std::ldexp((bits & 0x3ff) | 0x400, exponent - 25);
+    return bits & 0x8000 ? -magnitude : magnitude;
+  }
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// The fewest significant digits of a literal that encodes to
+// 'bits', found by binary search on the digits of its value.
+int fewest_digits(const Interpreter::State& state, const uint64_t bits) {
+  const double value = widen(state, bits);
+  char buffer[400];
+  const auto encodes = [&](const int digits) {
+    std::snprintf(buffer, sizeof(buffer), "%.*e", digits - 1, value);
+    return narrow(state, std::strtod(buffer, nullptr)) == bits;
+  };
+  int low = 1, high = std::numeric_limits<double>::max_digits10;
+  while (low < high) {
+    const int middle = (low + high) / 2;
+    if (encodes(middle))
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  return low;
+}
+
+// The significant digits of a literal, of which zero has one.
+int significant_digits(const char* begin, const char* end) {
+  std::string digits;
+  for (; begin != end && *begin != 'e'; ++begin)
+    if (*begin >= '0' && *begin <= '9')
+      digits += *begin;
+  const auto first = digits.find_first_not_of('0');
+  if (first == std::string::npos)
+    return 1;
+  return digits.find_last_not_of('0') + 1 - first;
+}
+
+int failures = 0;
+
+void check(const char* const type, const uint64_t bits) {
+  const auto state = parse_state(type);
+  char literal[64];
+  const auto end = float_literal(state, bits, literal);
+  const std::string text(literal, end);
+  if (text.empty() || text == "nan" || text == "+inf" || text == "-inf")
+    return;
+  const bool encodes
+    = narrow(state, std::strtod(text.c_str(), nullptr)) == bits;
+  const int digits = significant_digits(literal, end);
+  if (encodes && digits <= fewest_digits(state, bits))
+    return;
+  if (++failures <= 10)
+    std::fprintf(stderr, "%s 0x%llx: '%s' %s.\n", type,
+      (unsigned long long)bits, text.c_str(),
+      encodes ? "is longer than it needs to be" : "doesn't encode to it");
+}
+
+// SplitMix64, for a sample of values that is the same on
+// every run.
+uint64_t next(uint64_t& seed) {
+  uint64_t z = (seed += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+}
+
+int main() {
+  for (uint64_t bits = 0; bits < 0x10000; ++bits) {
+    check("f16", bits);
+    check("bf16", bits);
+  }
+  // The edges of each binade, where the interval is uneven,
+  // and of the subnormals.
+  for (uint64_t exponent = 0; exponent < 0xff; ++exponent)
+    for (uint64_t significand = 0; significand < 4; ++significand) {
+      check("f32", exponent << 23 | significand);
+      check("f32", exponent << 23 | (0x7fffff - significand));
+    }
+  for (uint64_t exponent = 0; exponent < 0x7ff; ++exponent)
+    for (uint64_t significand = 0; significand < 4; ++significand) {
+      check("f64", exponent << 52 | significand);
+      check("f64", exponent << 52 | ((uint64_t(1) << 52) - 1 - significand));
+    }
+  uint64_t seed = 0;
+  for (int i = 0; i < 100000; ++i) {
+    const auto bits = next(seed);
+    check("f32", bits >> 32);
+    check("f64", bits);
+  }
+  if (failures) {
+    std::fprintf(stderr, "Test 'float-literals' FAILED.\n"
+      "%d literals were wrong.\n", failures);
+    return 1;
+  }
+  std::printf("Test 'float-literals' passed.\n");
+}
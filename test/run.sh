@@ -11,22 +11,33 @@ fi
 PD="$1"
 shift
 
+# Each test is run with and without optimization, which must
+# not change the output, and checked without writing output,
+# which must report the same errors.
 function run_test {
+  run_test_with "$1" "" &&
+  run_test_with "$1" "--no-opt" &&
+  run_test_with "$1" "--check"
+}
+
+function run_test_with {
 
   set +e +E
 
   test_file="$1"
+  flags="$2"
   test_name="$(basename "$test_file" ".pd")"
-  actual_out="$here/$test_name.out.actual"
+  actual_name="$test_name${flags:+.${flags#--}}"
+  actual_out="$here/$actual_name.out.actual"
   expect_out="$here/$test_name.out.expect"
-  actual_err="$here/$test_name.err.actual"
+  actual_err="$here/$actual_name.err.actual"
   expect_err="$here/$test_name.err.expect"
 
   if [ ! -e "$expect_err" ]; then
     expect_err=/dev/null
   fi
 
-  $PD "$test_file" -o "$actual_out" 2> "$actual_err"
+  $PD "$test_file" $flags -o "$actual_out" 2> "$actual_err"
 
   if [ ! -e "$expect_out" ]; then
     echo "Test '$test_name' BROKEN." >&2
@@ -35,7 +46,7 @@ function run_test {
   fi
 
   if ! diff -u "$expect_err" "$actual_err"; then
-    echo "Test '$test_name' FAILED." >&2
+    echo "Test '$test_name'${flags:+ ($flags)} FAILED." >&2
     echo "Negative test output does not match expected." >&2
     echo
     echo "Expected:" >&2
@@ -47,13 +58,13 @@ function run_test {
     exit 1
   fi
 
-  if ! diff -q "$expect_out" "$actual_out"; then
-    echo "Test '$test_name' FAILED." >&2
+  if [ "$flags" != "--check" ] && ! diff -q "$expect_out" "$actual_out"; then
+    echo "Test '$test_name'${flags:+ ($flags)} FAILED." >&2
     echo "Positive test output does not match expected." >&2
     exit 1
   fi
 
-  echo "Test '$test_name' passed."
+  echo "Test '$test_name'${flags:+ ($flags)} passed."
 
   set -e -E
 
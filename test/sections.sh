@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Checks that the sizes of sections written to files, and not
+# only counted, include output placed past their ends by 'at'.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: sections.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'sections' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Checks that SOURCE writes OUTPUT, in hex, with a section 'a'
+# of SIZE bytes, which '--size' reports as well.
+function sizes {
+  "$PD" -e "$1" -o output -o a=section 2> error \
+    || fail "Unable to compile '$1': $(cat error)"
+  [ "$(xxd -p output)" = "$2" ] \
+    || fail "Expected '$2' for '$1' but found '$(xxd -p output)'."
+  [ "$(stat -c %s section)" = "$3" ] \
+    || fail "Expected section of $3 bytes for '$1'."
+  [ "$("$PD" --size -e "$1" -o a=section)" = "$(printf '%s\na %s' \
+    "$(stat -c %s output)" "$3")" ] \
+    || fail "Sizes of '$1' differ with '--size'."
+}
+
+sizes 'u8 section("a") { 1 2 } size_of("a")' 02 2
+sizes 'u8 section("a") { 1 at(10) { 2 } } size_of("a")' 0b 11
+sizes 'u8 section("a") { 1 at(10) { 2 } 3 } size_of("a")' 0b 11
+sizes 'u8 section("a") { 1 2 3 at(1) { 4 } } size_of("a")' 03 3
+sizes 'u8 section("a") { at(4) { 1 } at(2) { 2 } } size_of("a")' 05 5
+
+echo "Test 'sections' passed."
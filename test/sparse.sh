@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Checks that bytes skipped over by 'at' are left as holes, and
+# not allocated, with each way of writing a file that can seek.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: sparse.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'sparse' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+truncate -s 1M hole
+if [ "$(stat -c %b hole)" != 0 ]; then
+  echo "Test 'sparse' skipped: the file system has no sparse files."
+  exit 0
+fi
+
+# Checks that SOURCE, compiled with OPTIONS, writes 'expected'
+# in no more than 64 KiB of blocks.
+function sparse {
+  rm -f output
+  "$PD" $2 -e "$1" -o output 2> error \
+    || fail "Unable to compile '$1' with '$2': $(cat error)"
+  cmp -s output expected || fail "Wrong output for '$1' with '$2'."
+  [ "$(($(stat -c '%b * %B' output)))" -le 65536 ] \
+    || fail "Gaps in '$1' were allocated with '$2'."
+}
+
+# Within the space preallocated ahead of the output by '--mmap',
+# and past it.
+for offset in 900000 40000000; do
+  rm -f expected
+  printf '\1' > expected
+  printf '\2' | dd of=expected bs=1 seek="$offset" conv=notrunc 2> /dev/null
+  for options in "" --mmap; do
+    sparse "u8 1 at($offset) { 2 }" "$options"
+  done
+done
+
+echo "Test 'sparse' passed."
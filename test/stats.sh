@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Checks the counts reported by '--stats', which don't depend
+# on the optimizer, and that the report doesn't change the
+# output.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: stats.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'stats' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+if ! "$PD" --stats -e '' 2> /dev/null > /dev/null; then
+  echo "Test 'stats' skipped: built without '--stats'."
+  exit 0
+fi
+
+# Checks that the JSON report for SOURCE has each FIELD given
+# as a 'FIELD: VALUE' line, with and without '--no-opt'.
+function reports {
+  local source="$1"
+  shift
+  for options in "" "--no-opt"; do
+    "$PD" $options --stats=json -e "$source" -o output 2> report \
+      || fail "Unable to compile '$source': $(cat report)"
+    "$PD" $options -e "$source" -o expected \
+      || fail "Unable to compile '$source' without '--stats'."
+    cmp -s output expected \
+      || fail "Output of '$source' changed with '--stats'."
+    for field in "$@"; do
+      grep -qxF "  $field," report \
+        || fail "Expected '$field' for '$source' $options in: $(cat report)"
+    done
+  done
+}
+
+reports 'u16 3' '"bytes_read": 5' '"bytes_written": 2' '"max_depth": 1' \
+  '"tokens": {"type": 1, "integer": 1}' '"values": {"integer16": 1}'
+reports '{ u16 3 }' '"bytes_written": 2' '"max_depth": 2'
+reports 'u8 { { 1 } { { 2 } } }' '"bytes_written": 2' '"max_depth": 4'
+reports 'u3 1 2 3' '"bytes_written": 2' '"unaligned_bits": 9'
+
+"$PD" --stats -e '{ u16 3 }' -o output 2> report \
+  || fail "Unable to compile with '--stats'."
+grep -qxF 'Maximum state depth: 2' report \
+  || fail "Expected a depth of 2 in: $(cat report)"
+grep -q '^CPU time by phase, from [0-9]* samples: other ' report \
+  || fail "Expected CPU time by phase in: $(cat report)"
+
+# Counters are optional, but mustn't stop the compilation.
+"$PD" --stats=json --stats-counters -e 'u8 1' -o output 2> report \
+  || fail "Unable to compile with '--stats-counters'."
+[ "$(xxd -p output)" = 01 ] || fail "Output changed with '--stats-counters'."
+grep -q '^  "phase_cpu_seconds": {"other": ' report \
+  || fail "Expected CPU time by phase in: $(cat report)"
+
+echo "Test 'stats' passed."
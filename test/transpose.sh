@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Checks that rows imported with '--columns --transpose' are
+# written a column at a time, as the equivalent source would
+# be, whether the columns are held in memory or spilled to
+# temporary files, and that invalid options are reported.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: transpose.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'transpose' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Imports the file 'input' with the given options, and compares
+# the output with that of SOURCE.
+function imports_as {
+  local source="$1"
+  shift
+  "$PD" "$@" input -o imported || fail "Unable to import with '$*'."
+  "$PD" -e "$source" -o compiled || fail "Unable to compile '$source'."
+  cmp -s compiled imported || fail "Import with '$*' is not '$source'."
+}
+
+# Imports the file 'input' with the given options, which must
+# fail with a message matching PATTERN.
+function rejects {
+  local pattern="$1"
+  shift
+  "$PD" "$@" input -o imported 2> error &&
+    fail "Import with '$*' succeeded."
+  [[ "$(cat error)" == $pattern ]] ||
+    fail "Import with '$*' failed with: $(cat error)"
+}
+
+printf '1 2\n3 4\n5 6\n' > input
+imports_as 'u8 1 3 5 u16 2 4 6' --columns 'u8 u16' --transpose
+imports_as 'u8 1 3 5 0 u16 2 4 6' --columns 'u8 u16' --transpose=4
+imports_as 'u8 1 3 5 0 0 0 0 0 big u16 2 4 6' \
+  --columns 'u8 big u16' --transpose=8
+imports_as 'u3 1 3 5 u7 0 u8 2 4 6' --columns 'u3 u8' --transpose
+imports_as 'u8 1 2 2 u16 2 4 6' --columns 'delta u8 absolute u16' --transpose
+
+# Columns larger than their share of memory are spilled to
+# temporary files, which must hold the same bytes.
+seq 0 2999 | awk '{ print $1, $1 * 7, -$1 }' > input
+mkdir spill
+TMPDIR="$work/spill" imports_as \
+  'u64 range(0, 3000) u32 range(0, 21000, 7) s16 range(0, -3000, -1)' \
+  --columns 'u64 u32 s16' --transpose --transpose-memory 12288
+[ -z "$(ls spill)" ] || fail "Temporary files were left behind."
+TMPDIR="$work/missing" rejects \
+  "Unable to write temporary file: '$work/missing/pd-spill-*'." \
+  --columns 'u64 u32 s16' --transpose --transpose-memory 12288
+TMPDIR="$work/missing" imports_as \
+  'u64 range(0, 3000) u32 range(0, 21000, 7) s16 range(0, -3000, -1)' \
+  --columns 'u64 u32 s16' --transpose
+
+# Invalid options.
+rejects "Invalid value for option: '--transpose=0'." \
+  --columns 'u8' --transpose=0
+rejects "Invalid value for option: '--transpose-memory'." \
+  --columns 'u8' --transpose --transpose-memory 1k
+rejects "Option '--transpose' requires '--columns'." --transpose
+rejects "Option '--transpose-memory' requires '--transpose'." \
+  --columns 'u8' --transpose-memory 4096
+rejects "Options '--align' and '--transpose' can't be used together." \
+  --columns 'u8' --align --transpose
+
+echo "Test 'transpose' passed."
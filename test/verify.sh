@@ -0,0 +1,101 @@
+#!/bin/bash
+
+# Checks that '--verify' passes identical output and reports
+# the offset of the first difference, and that output written
+# with '--write-if-changed' leaves an identical file untouched
+# and replaces a changed one, including output that uses 'at'.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: verify.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'verify' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# Writes the output of SOURCE to 'expected' for comparison.
+function expect {
+  "$PD" -e "$1" -o expected || fail "Unable to compile '$1'."
+}
+
+# Checks that verifying the output of SOURCE against
+# 'expected' succeeds.
+function verifies {
+  "$PD" --verify expected -e "$1" 2> error \
+    || fail "Output of '$1' should verify: $(cat error)"
+}
+
+# Checks that verifying the output of the file SOURCE against
+# 'expected' fails at OFFSET, reported without a position in
+# the source.
+function differs_at {
+  printf '%s' "$1" > source.pd
+  "$PD" --verify expected source.pd 2> error \
+    && fail "Output of '$1' should not verify."
+  local message="Output differs from 'expected' at offset $2."
+  [ "$(cat error)" = "$message" ] \
+    || fail "Expected '$message' for '$1' but found: $(cat error)"
+}
+
+expect 'u8 1 2 3 4'
+verifies 'u8 1 2 3 4'
+verifies 'u8 1 2 { big u16 0x0304 }'
+differs_at 'u8 1 2 7 4' 2
+differs_at $'u8 1\n\nu8 2 3 4 5' 4
+differs_at 'u8 1 2 3' 3
+differs_at 'u8' 0
+
+[ "$(cat expected | xxd -p)" = 01020304 ] \
+  || fail "'--verify' changed the file it compared with."
+
+# Checks that compiling SOURCE with '--write-if-changed' to
+# 'output' leaves it as the plain output of SOURCE, and only
+# writes it if CHANGED is 'changed'.
+function writes {
+  "$PD" -e "$1" -o expected || fail "Unable to compile '$1'."
+  touch -d '2001-01-01' output
+  "$PD" --write-if-changed -e "$1" -o output 2> error \
+    || fail "Unable to compile '$1' if changed: $(cat error)"
+  cmp -s expected output || fail "Output of '$1' was written wrongly."
+  local time="$(stat -c %Y output)"
+  if [ "$2" = changed ]; then
+    [ "$time" != "$(date -d '2001-01-01' +%s)" ] \
+      || fail "Output of '$1' should have replaced the file."
+  else
+    [ "$time" = "$(date -d '2001-01-01' +%s)" ] \
+      || fail "Output of '$1' should have left the file untouched."
+  fi
+  ! ls output.* > /dev/null 2>&1 \
+    || fail "Output of '$1' left a temporary file."
+}
+
+rm -f output
+"$PD" --write-if-changed -e 'u8 1 2' -o output \
+  || fail "Unable to create a file with '--write-if-changed'."
+[ "$(xxd -p output)" = 0102 ] \
+  || fail "'--write-if-changed' didn't create a missing file."
+
+writes 'u8 1 2' unchanged
+writes 'u8 1 3' changed
+writes 'u8 1 3 4' changed
+writes 'u8 1 3' changed
+writes 'u8 1 2 3 at(8) { u8 9 9 } u8 4 at(1) { big u16 0x0707 } u8 5' \
+  changed
+writes 'u8 1 2 3 at(8) { u8 9 9 } u8 4 at(1) { big u16 0x0707 } u8 5' \
+  unchanged
+writes 'u8 1 0 0 at(8) { u8 9 9 } u8 4 at(1) { big u16 0x0707 } u8 5' \
+  unchanged
+writes 'u8 1 2 3 at(8) { u8 9 8 } u8 4 at(1) { big u16 0x0707 } u8 5' \
+  changed
+
+echo "Test 'verify' passed."
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Checks that source compressed with zstd is decompressed as it
+# is read, in builds made with 'make ZSTD=1', including frames
+# one after another, and that input which ends early or is
+# corrupt is reported. Other builds must refuse it clearly.
+
+cd "$(dirname "$0")"
+
+if [ "$#" -lt 1 ]; then
+  echo "Usage: zstd-input.sh /path/to/pd" >&2
+  exit 1
+fi
+
+PD="$1"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+function fail {
+  echo "Test 'zstd-input' FAILED." >&2
+  echo "$1" >&2
+  exit 1
+}
+
+# A zstd frame holding nothing, for builds without zstd.
+printf '\x28\xb5\x2f\xfd\x20\x00\x01\x00\x00' > empty.pd
+if ! "$PD" --compress=zstd -e '' -o /dev/null 2> /dev/null; then
+  ! "$PD" empty.pd -o output 2> error \
+    || fail "zstd input was accepted in a build without zstd."
+  grep -qF "Input compressed with zstd, which is not supported" error \
+    || fail "Unexpected error for zstd input: $(cat error)"
+  echo "Test 'zstd-input' skipped: built without zstd."
+  exit 0
+fi
+
+# Writes SOURCE, as text, to the file PATH, compressed with zstd.
+function compressed {
+  "$PD" --compress=zstd -e "utf8 \"$1\"" -o "$2" \
+    || fail "Unable to compress '$1'."
+}
+
+# Checks that the file 'input.pd' compiles to HEX.
+function compiles {
+  "$PD" input.pd -o output 2> error \
+    || fail "Unable to compile: $(cat error)"
+  [ "$(xxd -p output)" = "$1" ] \
+    || fail "Expected '$1' but found '$(xxd -p output)'."
+}
+
+# Checks that compiling the file 'input.pd' reports ERROR.
+function reports {
+  ! "$PD" input.pd -o output 2> error || fail "Expected an error: $1"
+  grep -qF "$1" error || fail "Expected '$1' but found: $(cat error)"
+}
+
+compressed 'u8 1 2 3\n' input.pd
+compiles 010203
+
+# The second frame continues the token the first ends in.
+compressed 'u8 1 1' first
+compressed '2 3\n' second
+cat first second > input.pd
+compiles 010c03
+
+compressed 'u8 1 2 3\n' whole
+head -c -2 whole > input.pd
+reports 'Unexpected end of zstd data.'
+
+# A frame header with its reserved bit set.
+cp whole input.pd
+printf '\xff' | dd of=input.pd bs=1 seek=4 conv=notrunc 2> /dev/null
+reports 'Invalid zstd data: '
+
+echo "Test 'zstd-input' passed."
@@ -1,5 +1,7 @@
 #include <write.h>
 
+#include <cstring>
+
 #define TYPE_NAME(TYPE, NAME) \
   template<> const char* type_name<TYPE>::value = NAME;
 
@@ -14,3 +16,112 @@ TYPE_NAME(int32_t,  "signed 32-bit");
 TYPE_NAME(int64_t,  "signed 64-bit");
 
 #undef TYPE_NAME
+
+namespace {
+
+// Shift right, rounding to nearest with ties to even.
+uint64_t round_shift(const uint64_t value, const int shift) {
+  if (shift == 0)
+    return value;
+  if (shift >= 64)
+    return 0;
+  const uint64_t result = value >> shift,
+    remainder = value & ((uint64_t(1) << shift) - 1),
+    half = uint64_t(1) << (shift - 1);
+  return result
+    + (remainder > half || (remainder == half && (result & 1)));
+}
+
+// Narrows a double directly to a binary floating-point
+// format with the given exponent and mantissa widths, so
+// that there is only one rounding step. Overflow rounds to
+// infinity, underflow to (signed) zero through subnormals,
+// and NaNs stay quiet NaNs.
+template<int EXPONENT_BITS, int MANTISSA_BITS>
+uint16_t narrow_float(const double input) {
+  uint64_t bits;
+  std::memcpy(&bits, &input, sizeof(bits));
+  const uint16_t sign
+    = uint16_t(bits >> 63) << (EXPONENT_BITS + MANTISSA_BITS);
+  const int exponent = (bits >> 52) & 0x7ff;
+  const uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+  const int maximum = (1 << EXPONENT_BITS) - 1;
+  const uint16_t infinity = maximum << MANTISSA_BITS;
+  if (exponent == 0x7ff)
+    return sign | infinity | (mantissa
+      ? (1 << (MANTISSA_BITS - 1)) | (mantissa >> (52 - MANTISSA_BITS))
+      : 0);
+  const int biased = (exponent ? exponent : 1) - 1023 + (maximum >> 1);
+  if (biased >= maximum)
+    return sign | infinity;
+  const uint64_t significand
+    = mantissa | (exponent ? uint64_t(1) << 52 : 0);
+  // Adding the rounded significand lets a carry propagate
+  // into the exponent, up to and including infinity.
+  return sign | (biased >= 1
+    ? ((biased - 1) << MANTISSA_BITS)
+      + round_shift(significand, 52 - MANTISSA_BITS)
+    : round_shift(significand, 52 - MANTISSA_BITS + 1 - biased));
+}
+
+}
+
+uint16_t half_from_double(const double input) {
+  return narrow_float<5, 10>(input);
+}
+
+uint16_t bfloat_from_double(const double input) {
+  return narrow_float<8, 7>(input);
+}
+
+// The variable-length encoders compute the encoded length
+// up front from the number of significant bits, then fill
+// in exactly that many bytes without testing each group.
+
+namespace {
+
+// Number of significant bits, counting zero as one bit.
+unsigned int significant_bits(const uint64_t value) {
+  return 64 - __builtin_clzll(value | 1);
+}
+
+}
+
+size_t encode_uleb128(const uint64_t value, uint8_t* const buffer) {
+  const size_t size = (significant_bits(value) + 6) / 7;
+  for (size_t i = 0; i < size; ++i)
+    buffer[i] = ((value >> (7 * i)) & 0x7f) | (i + 1 < size ? 0x80 : 0);
+  return size;
+}
+
+size_t encode_sleb128(const int64_t value, uint8_t* const buffer) {
+  // One more bit than the magnitude, for the sign.
+  const uint64_t magnitude = value ^ (value >> 63);
+  const size_t size = (significant_bits(magnitude) + 1 + 6) / 7;
+  for (size_t i = 0; i < size; ++i)
+    buffer[i] = ((value >> (7 * i)) & 0x7f) | (i + 1 < size ? 0x80 : 0);
+  return size;
+}
+
+size_t encode_zigzag(const int64_t value, uint8_t* const buffer) {
+  return encode_uleb128
+    ((uint64_t(value) << 1) ^ uint64_t(value >> 63), buffer);
+}
+
+// The number of trailing zero bits in the first byte gives
+// the number of bytes that follow it, and the value is
+// stored little-endian in the remaining bits. Values wider
+// than 56 bits get a zero first byte and all 64 bits after.
+size_t encode_prefix_varint(const uint64_t value, uint8_t* const buffer) {
+  const size_t size = (significant_bits(value) + 6) / 7;
+  if (size > 8) {
+    buffer[0] = 0;
+    for (size_t i = 0; i < 8; ++i)
+      buffer[i + 1] = value >> (8 * i);
+    return 9;
+  }
+  const uint64_t tagged = (value << size) | (uint64_t(1) << (size - 1));
+  for (size_t i = 0; i < size; ++i)
+    buffer[i] = tagged >> (8 * i);
+  return size;
+}
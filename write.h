@@ -17,6 +17,17 @@
 
 Term::Endianness platform_endianness();
 
+uint16_t half_from_double(double);
+uint16_t bfloat_from_double(double);
+
+// Variable-length encoders write at most 'max_varint_size'
+// bytes to the buffer and return how many they wrote.
+const size_t max_varint_size = 10;
+size_t encode_uleb128(uint64_t, uint8_t*);
+size_t encode_sleb128(int64_t, uint8_t*);
+size_t encode_zigzag(int64_t, uint8_t*);
+size_t encode_prefix_varint(uint64_t, uint8_t*);
+
 template<class T>
 void endian_copy(const T&, Term::Endianness, Stream&);
 
@@ -26,15 +37,23 @@ struct type_name {
 };
 
 template<class O, class I>
-void write_integer_value
-  (const Term::Endianness endianness, const I& input, Stream& output) {
-  typedef std::numeric_limits<decltype(input)> input_limits;
+O checked_integer(const I& input) {
   typedef std::numeric_limits<O> type_limits;
-  if (input < type_limits::min() || input > type_limits::max())
+  // Compared by sign first, as an unsigned input would
+  // otherwise be compared to a negative minimum as unsigned.
+  const bool negative = input < 0;
+  if (negative ? !type_limits::is_signed
+      || int64_t(input) < int64_t(type_limits::min())
+    : uint64_t(input) > uint64_t(type_limits::max()))
     throw std::runtime_error
       (join("Value exceeds range of ", type_name<O>::value, " integer."));
-  const O buffer(input);
-  endian_copy(buffer, endianness, output);
+  return O(input);
+}
+
+template<class O, class I>
+void write_integer_value
+  (const Term::Endianness endianness, const I& input, Stream& output) {
+  endian_copy(checked_integer<O>(input), endianness, output);
 }
 
 template<class O, class I>
@@ -44,6 +63,27 @@ void write_float_value
   endian_copy(buffer, endianness, output);
 }
 
+template<class I>
+void write_narrow_float_value(const Term::Endianness endianness,
+  const I& input, Stream& output, uint16_t (*narrow)(double)) {
+  const uint16_t buffer(narrow(input));
+  endian_copy(buffer, endianness, output);
+}
+
+template<class O, class I>
+void write_variable_value(const I& input, Stream& output,
+  size_t (*encode)(O, uint8_t*), const char* const name) {
+  typedef std::numeric_limits<O> type_limits;
+  const bool negative = input < 0;
+  if ((negative && !type_limits::is_signed)
+    || (!negative && uint64_t(input) > uint64_t(type_limits::max())))
+    throw std::runtime_error(join("Value (", input,
+      ") exceeds range of ", name, " integer."));
+  std::array<uint8_t, max_varint_size> buffer;
+  const auto size = encode(O(input), &buffer[0]);
+  output.write(buffer.begin(), buffer.begin() + size);
+}
+
 template<class O, class I>
 void write_unicode_value(const Term::Endianness endianness, const I& input,
   Stream& output, O* (*append)(uint32_t, O*)) {
@@ -78,7 +118,7 @@ void write_integer
       default:
         {
           const uint64_t buffer(input);
-          if (buffer & ~((1 << state.width) - 1))
+          if (buffer & ~((uint64_t(1) << state.width) - 1))
             throw std::runtime_error(join("Value (", buffer,
               ") exceeds range of unsigned ", state.width, "-bit integer."));
           output.write(buffer, state.width);
@@ -102,8 +142,8 @@ void write_integer
       default:
         {
           const int64_t promoted(input);
-          if (promoted < -(1 << (state.width - 1))
-            || promoted > (1 << (state.width - 1)) - 1)
+          if (promoted < -(int64_t(1) << (state.width - 1))
+            || promoted > (int64_t(1) << (state.width - 1)) - 1)
             throw std::runtime_error(join("Value (", promoted,
               ") exceeds range of signed ", state.width, "-bit integer."));
           uint64_t buffer;
@@ -121,6 +161,9 @@ void write_integer
     break;
   case Term::FLOAT:
     switch (state.width) {
+    case 16:
+      write_narrow_float_value(endianness, input, output, half_from_double);
+      break;
     case 32:
       write_float_value<float>(endianness, input, output);
       break;
@@ -131,6 +174,9 @@ void write_integer
       IMPOSSIBLE("invalid float bit width");
     }
     break;
+  case Term::BFLOAT:
+    write_narrow_float_value(endianness, input, output, bfloat_from_double);
+    break;
   case Term::UNICODE:
     switch (state.width) {
     case 8:
@@ -142,9 +188,72 @@ void write_integer
     default:
       IMPOSSIBLE("invalid Unicode bit width");
     }
+    break;
+  case Term::ULEB128:
+    write_variable_value(input, output, encode_uleb128, "unsigned LEB128");
+    break;
+  case Term::SLEB128:
+    write_variable_value(input, output, encode_sleb128, "signed LEB128");
+    break;
+  case Term::ZIGZAG:
+    write_variable_value(input, output, encode_zigzag, "zigzag");
+    break;
+  case Term::PREFIX_VARINT:
+    write_variable_value
+      (input, output, encode_prefix_varint, "prefix varint");
+    break;
   }
 }
 
+inline bool is_relative(const Interpreter::State& state) {
+  if (state.reference == Term::ABSOLUTE)
+    return false;
+  switch (state.format) {
+  case Term::FLOAT:
+  case Term::BFLOAT:
+  case Term::UNICODE:
+    return false;
+  default:
+    return true;
+  }
+}
+
+inline bool is_signed(const Interpreter::State& state) {
+  switch (state.format) {
+  case Term::INTEGER:
+    return state.signedness == Term::SIGNED;
+  case Term::SLEB128:
+  case Term::ZIGZAG:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Differences are taken modulo 2^64, as a decoder would add
+// them back, and written as signed values in signed formats.
+// In delta mode the base is the previous value; in frame of
+// reference mode it is the first value, written in full. A
+// value in a different mode from the last starts over.
+template<class T>
+void write_relative_integer(const Interpreter::State& state,
+  Interpreter::Base& base, const T& input, Stream& output) {
+  if (!is_relative(state)) {
+    write_integer(state, input, output);
+    return;
+  }
+  const bool first = base.reference != state.reference;
+  const Term::Unsigned difference
+    = Term::Unsigned(input) - (first ? 0 : base.value);
+  if (is_signed(state))
+    write_integer(state, Term::Signed(difference), output);
+  else
+    write_integer(state, difference, output);
+  if (state.reference == Term::DELTA || first)
+    base.value = Term::Unsigned(input);
+  base.reference = state.reference;
+}
+
 template<class T>
 void write_float
   (const Interpreter::State& state, const T& input, Stream& output) {
@@ -154,6 +263,10 @@ void write_float
       ("Float values cannot be written in integer format.");
   case Term::FLOAT:
     switch (state.width) {
+    case 16:
+      write_narrow_float_value
+        (state.endianness, input, output, half_from_double);
+      break;
     case 32:
       write_float_value<float>(state.endianness, input, output);
       break;
@@ -164,9 +277,19 @@ void write_float
       IMPOSSIBLE("invalid float bit width");
     }
     break;
+  case Term::BFLOAT:
+    write_narrow_float_value
+      (state.endianness, input, output, bfloat_from_double);
+    break;
   case Term::UNICODE:
     throw std::runtime_error
       ("Float values cannot be written in Unicode format.");
+  case Term::ULEB128:
+  case Term::SLEB128:
+  case Term::ZIGZAG:
+  case Term::PREFIX_VARINT:
+    throw std::runtime_error
+      ("Float values cannot be written in variable-length integer format.");
   }
 }
 
@@ -180,16 +303,23 @@ inline Term::Endianness platform_endianness() {
 }
 
 template<class T>
-void endian_copy
-  (const T& value, const Term::Endianness endianness, Stream& output) {
+std::array<uint8_t, sizeof(T)> endian_bytes
+  (const T& value, const Term::Endianness endianness) {
   using namespace std;
-  array<char, sizeof(T)> buffer;
-  const auto begin = reinterpret_cast<const char*>(&value),
+  array<uint8_t, sizeof(T)> buffer;
+  const auto begin = reinterpret_cast<const uint8_t*>(&value),
     end = begin + sizeof(T);
   copy(begin, end, buffer.begin());
   if (endianness != Term::NATIVE && endianness != platform_endianness())
     reverse(buffer.begin(), buffer.end());
-  output.write(buffer.begin(), buffer.end());
+  return buffer;
+}
+
+template<class T>
+void endian_copy
+  (const T& value, const Term::Endianness endianness, Stream& output) {
+  const auto buffer = endian_bytes(value, endianness);
+  output.write(&buffer[0], &buffer[0] + buffer.size());
 }
 
 #endif